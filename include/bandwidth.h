@@ -0,0 +1,64 @@
+/*
+ * CXLMemSim bandwidth
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#ifndef CXLMEMSIM_BANDWIDTH_H
+#define CXLMEMSIM_BANDWIDTH_H
+
+#include <cstdint>
+
+// 令牌桶: 令牌以 rate 字节/ns 补充, 上限为 burst; 令牌为负即为排队中的积压
+// Token bucket refilled at rate bytes/ns up to burst bytes. A negative balance is the running backlog, and a
+// request that leaves the balance negative waits until the bucket has refilled it.
+class TokenBucket {
+public:
+    TokenBucket() = default;
+    TokenBucket(double gbps, double burst_ns);
+    // 消耗 bytes 个令牌, 返回排队延迟 (ns)
+    double consume(uint64_t timestamp, uint64_t bytes);
+    // 令牌足够时消耗 bytes 并返回 true, 否则不消耗; 超过突发额度的请求在桶满时放行并透支
+    bool try_consume(uint64_t timestamp, uint64_t bytes);
+    double backlog() const { return tokens < 0 ? -tokens : 0.0; }
+    double rate() const { return bytes_per_ns; }
+    // timestamp 时刻新请求需要等待的时间 (ns), 不修改状态
+    double delay_at(uint64_t timestamp) const;
+
+private:
+    double bytes_per_ns = 0.0;
+    double burst = 0.0;
+    double tokens = 0.0;
+    uint64_t last_timestamp = 0;
+};
+
+// 每个 expander 一个, 读写分别限速, 延迟按样本增量累积
+// Per-expander bandwidth model with separate read and write buckets. Queueing delay accumulates per sample and
+// is handed out when the epoch asks for it, so nothing rescans the access window.
+class BandwidthEngine {
+public:
+    BandwidthEngine() = default;
+    BandwidthEngine(double read_gbps, double write_gbps, double burst_ns = 1000.0);
+    void record(uint64_t timestamp, uint64_t bytes, bool is_write);
+    // 取出上次调用以来累计的排队延迟 (ns)
+    double drain() {
+        double delay = pending_delay;
+        pending_delay = 0.0;
+        return delay;
+    }
+    double backlog() const { return read.backlog() + write.backlog(); }
+    // timestamp 时刻读写两个方向中较长的排队等待 (ns)
+    double delay_at(uint64_t timestamp) const;
+
+private:
+    TokenBucket read;
+    TokenBucket write;
+    double pending_delay = 0.0;
+};
+
+#endif // CXLMEMSIM_BANDWIDTH_H
@@ -56,8 +56,11 @@ public:
     int read(CXLController *, BPFTimeRuntimeElem *);
     BPFUpdater<uint64_t,uint64_t> *updater;
     pid_t tid;
+    // frees_map 的 fd, 第一次读取时按名字查找, 不依赖 map 在 cxlmemsim.bpf.c 中的声明顺序
+    int frees_map_fd = -1;
 };
 
+#define BPFTIME_MAX_MAP_FD 1024 // 按名字查找 map 时扫描的 fd 上限
 
 #define u64 unsigned long long
 #define u32 unsigned int
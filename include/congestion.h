@@ -0,0 +1,82 @@
+/*
+ * CXLMemSim congestion
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#ifndef CXLMEMSIM_CONGESTION_H
+#define CXLMEMSIM_CONGESTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+// 滑动窗口拥塞引擎: 以冲突阈值为桶宽的日历队列
+// Sliding-window congestion engine. Samples live in a calendar queue of buckets as wide as the conflict
+// threshold, so the neighbours of a new sample are always in its own or an adjacent bucket. Conflict counts
+// are kept up to date as samples arrive and expire, which makes a query O(new samples) instead of a full sort.
+// The window slides at bucket granularity.
+class CongestionEngine {
+public:
+    explicit CongestionEngine(uint64_t window = 100000, uint64_t threshold = 2000);
+
+    // 记录一次访问; track_address 为 false 时只参与时间冲突 (来自子交换机的访问)
+    // Record a sample. Samples forwarded from a child switch only take part in time conflicts. A sample of weight
+    // n stands for n back-to-back accesses at one timestamp, the first of which may be a write, and carries the
+    // n - 1 conflicts among them. Returns the number of new conflicts the sample created.
+    uint64_t record(uint64_t timestamp, uint64_t address, bool is_write, bool track_address = true,
+                    uint64_t weight = 1);
+    // 推进窗口并淘汰过期的桶
+    void advance(uint64_t now);
+    void set_window(uint64_t window) { this->window = window; }
+    void clear();
+
+    // 冲突延迟: 时间冲突 1x, 写-写 2x, 读-写 1.5x, 读-读 0.5x
+    double latency(double unit) const {
+        return unit * (time_conflicts + 2.0 * write_write + 1.5 * read_write + 0.5 * read_read);
+    }
+    size_t size() const { return samples; }
+
+    uint64_t time_conflicts = 0;
+    uint64_t write_write = 0;
+    uint64_t read_write = 0;
+    uint64_t read_read = 0;
+
+private:
+    struct sample {
+        uint64_t timestamp;
+        uint64_t address;
+        uint64_t weight;
+        bool is_write;
+        bool track_address;
+    };
+    // 同一地址的一段连续访问: 只有第一次可能是写, 之后都是读
+    struct access {
+        uint64_t timestamp;
+        uint64_t weight;
+        bool is_write;
+        bool last_is_write() const { return is_write && weight == 1; }
+    };
+    uint64_t window;
+    uint64_t threshold;
+    uint64_t now = 0;
+    uint64_t base = 0; // bucket number of buckets.front()
+    size_t samples = 0;
+    std::deque<std::vector<sample>> buckets; // each bucket sorted by timestamp
+    std::unordered_map<uint64_t, std::deque<access>> per_address; // sorted by timestamp
+
+    bool close(uint64_t a, uint64_t b) const { return b - a < threshold; }
+    int pair_delta(const access &a, const access &b, int sign);
+    int internal_delta(const access &a, int sign);
+    uint64_t add_to_address(const sample &s);
+    void expire_front();
+};
+
+#endif // CXLMEMSIM_CONGESTION_H
@@ -0,0 +1,55 @@
+/*
+ * CXLMemSim controller pool
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#ifndef CXLMEMSIM_CONTROLLERPOOL_H
+#define CXLMEMSIM_CONTROLLERPOOL_H
+
+#include "cxlcontroller.h"
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+// 内存池: 多个主机控制器共享同一组交换机和 expander
+// CXL 2.0 memory pooling. The Newick tree is built once under a fabric switch that every host's root port
+// connects to, so the switches and expanders below it, with their congestion windows and token buckets, see the
+// traffic of all hosts. Each host (one per target process) keeps its own local tier, host cache, policies and
+// thread state. Samples queued on a shared expander are charged to the path of the host whose producer queued
+// them, and queueing delay on shared links is split across hosts in proportion to their traffic on that link.
+class ControllerPool {
+public:
+    // 创建一个主机控制器 (自己的策略实例), attach 到 pool 后再配置本地层
+    using host_factory = std::function<CXLController *(ControllerPool *)>;
+
+    ControllerPool(host_factory make_host, CXLController *fabric);
+    ControllerPool(const ControllerPool &) = delete;
+    ControllerPool &operator=(const ControllerPool &) = delete;
+
+    // tgid 对应的主机, 第一次出现时创建
+    CXLController *host(uint64_t tgid);
+    // 采集线程 producer 为 tgid 读取样本, 返回其主机; 只在采集线程启动前调用
+    CXLController *producer_host(size_t producer, uint64_t tgid);
+    // 应用所有共享 expander 的队列并分摊共享链路的延迟, 然后执行各主机推迟的策略
+    size_t drain();
+    const std::vector<CXLController *> &hosts() const { return hosts_; }
+    CXLController *fabric() const { return fabric_; }
+
+private:
+    host_factory make_host;
+    CXLController *fabric_;
+    std::vector<CXLController *> hosts_;
+    std::unordered_map<uint64_t, CXLController *> by_tgid;
+    std::vector<CXLController *> by_producer;
+
+    CXLController *host_of(size_t producer) const;
+    void share_delays();
+};
+
+#endif // CXLMEMSIM_CONTROLLERPOOL_H
@@ -13,22 +13,101 @@
 #define CXLMEMSIM_CXLCONTROLLER_H
 
 #include "cxlendpoint.h"
+#include "hostcache.h"
 #include "lbr.h"
-#include <queue>
+#include "pagedirectory.h"
+#include "topology.h"
+#include <span>
 #include <string_view>
 
 class Monitors;
+class PolicyScheduler;
+class ControllerPool;
 struct mem_stats;
+struct alloc_info;
 struct proc_info;
 struct lbr;
 struct cntr;
 enum page_type { CACHELINE, PAGE, HUGEPAGE_2M, HUGEPAGE_1G };
+// 每条记录按页类型折算的字节数, 与容量比较时使用
+inline uint64_t page_bytes(page_type pt) {
+    switch (pt) {
+    case CACHELINE:
+        return 64;
+    case HUGEPAGE_2M:
+        return 2 * 1024 * 1024;
+    case HUGEPAGE_1G:
+        return 1024 * 1024 * 1024;
+    default:
+        return 4096;
+    }
+}
+
+#define MIGRATION_SHOOTDOWN_LATENCY 4000.0 // 每次迁移的 TLB shootdown 延迟 (ns)
+#define MIGRATION_BUDGET_BURST 1000000.0 // 迁移预算可以一次用掉的额度 (ns)
+#define VA_PA_MIN_ENTRIES (1 << 16) // va_pa_map 超过该大小后才开始清理
+
+// 解码后的一条 PEBS 采样, index 为累计的 LLC miss 数
+struct mem_sample {
+    uint64_t timestamp;
+    uint64_t tid;
+    uint64_t phys_addr;
+    uint64_t virt_addr;
+    int index;
+};
+
+// 策略运行的节奏: 每 samples 次访问或每 interval ns 运行一次, 0 表示不按该维度触发
+struct policy_cadence {
+    uint64_t samples = 0;
+    uint64_t interval = 0;
+};
+
+// 一个采集线程的路由状态和推迟的更新, 只由该线程写入, 在 drain 时合并进控制器
+// Routing state of one PEBS reader. The miss index and timestamp are those of the reader's own perf event, so
+// sample weights do not depend on how readers interleave. Updates to shared controller state are buffered here
+// and merged at the epoch boundary, so readers only contend on the host cache and on policy calls.
+struct alignas(64) ingest_context {
+    struct placement {
+        uint64_t timestamp;
+        uint64_t phys_addr;
+        int device; // PageDirectory::local 为本地层访问, 否则只记录页所在的 expander
+    };
+    struct llcm_update {
+        uint64_t tid;
+        int type;
+        int64_t count;
+    };
+    struct heat_sample {
+        uint64_t addr;
+        uint64_t timestamp;
+        uint64_t weight;
+    };
+    int last_index = 0;
+    uint64_t last_timestamp = 0;
+    uint64_t requests = 0;
+    std::vector<placement> placements;
+    std::vector<std::pair<uint64_t, uint64_t>> va_pa; // 虚拟页 -> 物理页
+    std::vector<llcm_update> llcm; // 合并时推入各线程的 llcm_type
+    std::vector<heat_sample> observed; // 合并时交给迁移策略的 observe_access
+
+    void push_llcm(uint64_t tid, int type, int64_t count) {
+        if (count <= 0)
+            return;
+        if (!llcm.empty() && llcm.back().tid == tid && llcm.back().type == type)
+            llcm.back().count += count;
+        else
+            llcm.push_back({tid, type, count});
+    }
+    bool empty() const { return placements.empty() && va_pa.empty() && llcm.empty() && observed.empty() && !requests; }
+};
 
 class Policy {
 public:
     virtual ~Policy() = default;
     Policy() = default;
     virtual int compute_once(CXLController *) = 0; // reader writer
+    // 策略自己的节奏, 两项都为 0 时使用控制器的默认节奏
+    virtual policy_cadence cadence() const { return {}; }
 };
 
 class AllocationPolicy : public Policy {
@@ -36,6 +115,10 @@ public:
     AllocationPolicy();
     virtual ~AllocationPolicy() = default;
     int compute_once(CXLController *controller) override { return 0; };
+    // 为 phys_addr 所在的页选择设备 (-1 为本地), 默认与页无关
+    virtual int place(CXLController *controller, uint64_t timestamp, uint64_t phys_addr) {
+        return compute_once(controller);
+    }
 };
 
 class MigrationPolicy : public Policy {
@@ -52,21 +135,24 @@ public:
 
     // 获取需要迁移的地址列表
     // Get the list of addresses that need migration
-    std::vector<std::tuple<uint64_t, uint64_t>> get_migration_list(CXLController *controller) {
+    virtual std::vector<std::tuple<uint64_t, uint64_t>> get_migration_list(CXLController *controller) {
         std::vector<std::tuple<uint64_t, uint64_t>> migration_list;
         // 基类提供空实现
         // Base class provides empty implementation
         return migration_list;
     }
+    // 摄取时按页报告访问, 策略可以增量维护自己的统计; 可能与 get_migration_list 在不同线程上调用
+    // Called on ingest once per (thread, page) group with its total weight
+    virtual void observe_access(uint64_t addr, uint64_t timestamp, uint64_t weight) {}
     // 判断特定地址是否应该迁移
     // Determine if a specific address should be migrated
     virtual bool should_migrate(uint64_t addr, uint64_t timestamp, int current_device) { return false; }
 
-    // 为给定地址选择最佳的目标设备
-    // Select the best target device for a given address
+    // 为给定地址选择最佳的目标设备: expander id 或 PageDirectory::local
+    // Select the best target device for a given address; PageDirectory::none leaves the choice to the controller
     virtual int select_target_device(uint64_t addr, int current_device, CXLController *controller) {
-        return -1; // -1表示不迁移
-                   // -1 means no migration
+        return PageDirectory::none; // 由控制器按容量和负载选择
+                                    // Let the controller pick by capacity and load
     }
 };
 
@@ -109,106 +195,6 @@ public:
     }
 };
 
-struct LRUCacheEntry {
-    uint64_t key; // 缓存键（地址）
-                  // Cache key (address)
-    uint64_t value; // 缓存值
-                    // Cache value
-    uint64_t timestamp; // 最后访问时间戳
-                        // Last access timestamp
-};
-
-// LRU缓存
-// LRU cache
-class LRUCache {
-public:
-    int capacity; // 缓存容量
-                  // Cache capacity
-    std::unordered_map<uint64_t, LRUCacheEntry> cache; // 缓存映射
-                                                       // Cache mapping
-    std::list<uint64_t> lru_list; // LRU列表，最近使用的在前面
-                                  // LRU list, most recently used at front
-    std::unordered_map<uint64_t, std::list<uint64_t>::iterator> lru_map; // 用于O(1)查找列表位置
-                                                                         // For O(1) lookup of list positions
-
-    explicit LRUCache(int size) : capacity(size) {}
-
-    // 获取缓存值，如果存在则更新访问顺序
-    // Get cache value, update access order if it exists
-    std::optional<uint64_t> get(uint64_t key, uint64_t timestamp) {
-        auto it = cache.find(key);
-        if (it == cache.end()) {
-            return std::nullopt; // 缓存未命中
-                                 // Cache miss
-        }
-
-        // 更新访问顺序
-        // Update access order
-        lru_list.erase(lru_map[key]);
-        lru_list.push_front(key);
-        lru_map[key] = lru_list.begin();
-
-        // 更新时间戳
-        // Update timestamp
-        it->second.timestamp = timestamp;
-
-        return it->second.value; // 返回缓存值
-                                 // Return cache value
-    }
-
-    // 添加或更新缓存
-    // Add or update cache
-    void put(uint64_t key, uint64_t value, uint64_t timestamp) {
-        // 如果已存在，先移除旧位置
-        if (cache.find(key) != cache.end()) {
-            lru_list.erase(lru_map[key]);
-        }
-        // 如果缓存已满，移除最久未使用的项
-        else if (cache.size() >= capacity) {
-            uint64_t lru_key = lru_list.back();
-            lru_list.pop_back();
-            lru_map.erase(lru_key);
-            cache.erase(lru_key);
-        }
-
-        // 添加新项到最前面（最近使用）
-        lru_list.push_front(key);
-        lru_map[key] = lru_list.begin();
-        cache[key] = {key, value, timestamp};
-    }
-
-    // 获取缓存使用情况统计
-    std::tuple<int, int> get_stats() { return {cache.size(), capacity}; }
-
-    // 清除缓存
-    void clear() {
-        cache.clear();
-        lru_list.clear();
-        lru_map.clear();
-    }
-    // LRU缓存类中添加size()方法
-    size_t size() const { return cache.size(); }
-
-    // LRU缓存类中添加remove()方法
-    bool remove(uint64_t key) {
-        auto it = cache.find(key);
-        if (it == cache.end()) {
-            return false; // 键不存在
-        }
-
-        // 从LRU列表中移除
-        lru_list.erase(lru_map[key]);
-
-        // 从映射中移除
-        lru_map.erase(key);
-
-        // 从缓存中移除
-        cache.erase(key);
-
-        return true;
-    }
-};
-
 class CXLController : public CXLSwitch {
 public:
     std::vector<CXLMemExpander *> cur_expanders{};
@@ -218,51 +204,137 @@ public:
     PagingPolicy *paging_policy{};
     CachingPolicy *caching_policy{};
     CXLCounter counter;
-    std::map<uint64_t, occupation_info> occupation;
+    // 本地层: 地址哈希索引 + 按时间排序的环, 以 (聚合后的) 地址作为稳定句柄
+    OccupationStore occupation;
     page_type page_type_; // percentage
-    // no need for va pa map because v-indexed will not caught by us
+    // 虚拟页 -> 物理页, 用于把 free/munmap 的虚拟区间翻译成要淘汰的物理区间
+    // 超过 va_pa_limit 时删除物理页已不在任何层中的映射, 大小随驻留页数而不是样本数增长
+    std::unordered_map<uint64_t, uint64_t> va_pa_map;
+    size_t va_pa_limit = VA_PA_MIN_ENTRIES;
+    // 物理页 -> 设备 (本地层或 expander id), 替代迁移/失效时对所有设备的扫描
+    PageDirectory directory;
     int num_switches = 0;
     int num_end_points = 0;
-    int last_index = 0;
     uint64_t freed = 0;
     double latency_lat{};
     double bandwidth_lat{};
     double dramlatency;
     std::unordered_map<int, CXLMemExpander *> device_map;
-    // ring buffer
-    std::queue<lbr> ring_buffer;
-    // rob info
-    std::unordered_map<uint64_t, thread_info> thread_map;
-    // LRU cache
-    LRUCache lru_cache;
+    // construct_topo 结束时编译, 热路径只访问这里的数组
+    Topology topology;
+    // 内存池模式: 交换机和 expander 由 pool 共享, 共享链路的排队延迟按本主机的流量分摊到 pooled_delay
+    ControllerPool *pool = nullptr;
+    std::vector<uint64_t> device_traffic; // 按设备 id, 本 epoch 的访问数
+    std::vector<uint64_t> link_traffic; // 按拓扑中的交换机 id, 经过其上游链路的访问数
+    double pooled_delay = 0.0;
+    // 迁移代价: 拷贝占用源端读带宽和目的端写带宽, 拷贝与 TLB shootdown 的停顿记入 migration_delay (ns),
+    // 预算中剩余的令牌不够一次拷贝时跳过该迁移, 由策略在之后重新提出
+    TokenBucket migration_budget; // 未配置时不限速
+    double shootdown_latency = MIGRATION_SHOOTDOWN_LATENCY;
+    double migration_delay = 0.0;
+    uint64_t migrated_bytes = 0;
+    uint64_t migrations_throttled = 0;
+    uint64_t migrations_no_room = 0; // 没有未满的目标设备而跳过的迁移
+    // rob info: 线程创建时分配稠密编号, 之后按编号直接访问
+    std::vector<thread_info> threads;
+    std::unordered_map<uint64_t, uint32_t> thread_index;
+    // 组相联主机缓存
+    HostCache host_cache;
+    // 并发采集: 每个 producer 一个路由上下文, 只有主机缓存和策略调用各自加锁;
+    // 远程访问入队到 expander, 其余更新推迟到 drain 合并
+    std::vector<ingest_context> contexts;
+    ingest_context serial; // 同步插入的上下文, 每批结束时立即合并
+    ingest_context unregistered; // 未注册的 producer 共用, 由 ingest_mutex_ 保护
+    std::mutex ingest_mutex_;
+    std::mutex cache_mutex_;
+    std::mutex policy_mutex_;
+    uint64_t request_counter = 0; // 距上次运行迁移/失效策略以来的访问数
+    // 迁移/失效策略的默认节奏; 设置了 scheduler 时策略在后台线程上对快照运行
+    policy_cadence cadence{1000, 0};
+    uint64_t last_policy_run = 0;
+    PolicyScheduler *scheduler = nullptr;
 
     explicit CXLController(std::array<Policy *, 4> p, int capacity, page_type page_type_, int epoch,
                            double dramlatency);
     void construct_topo(std::string_view newick_tree);
+    // 作为内存池中的一个主机接入 fabric (已 construct_topo 的共享拓扑), 代替 construct_topo
+    void attach(ControllerPool *pool_, CXLController *fabric);
     void insert_end_point(CXLMemExpander *end_point);
     std::vector<std::string> tokenize(const std::string_view &s);
-    std::tuple<double, std::vector<uint64_t>> calculate_congestion() override;
+    double calculate_congestion(uint64_t timestamp) override;
     void set_epoch(int epoch) override;
     std::vector<std::tuple<uint64_t, uint64_t>> get_access(uint64_t timestamp) override;
-    double calculate_latency(const std::vector<std::tuple<uint64_t, uint64_t>> &elem,
+    double calculate_latency(uint64_t timestamp,
                              double dramlatency) override; // traverse the tree to calculate the latency
-    double calculate_bandwidth(const std::vector<std::tuple<uint64_t, uint64_t>> &elem) override;
+    double calculate_bandwidth(uint64_t timestamp) override;
+    uint32_t thread_id(uint64_t tid);
+    thread_info &thread(uint64_t tid) { return threads[thread_id(tid)]; }
     void insert_one(thread_info &t_info, lbr &lbr);
     int insert(uint64_t timestamp, uint64_t tid, lbr lbrs[32], cntr counters[32]);
-    int insert(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr, int index) override;
+    // 单条 PEBS 采样; index 为累计的 LLC miss 数, 与 index - last_index 成为样本的权重
+    int insert(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr, int index);
+    // 批量插入: 按 (线程, 页) 分组, 分配/页表/缓存策略每组只调用一次
+    int insert(std::span<const mem_sample> samples);
+    // 多个 PEBS 读线程并发调用, producer 为调用者的编号
+    int insert_concurrent(int producer, std::span<const mem_sample> samples);
+    // 在 producers 启动前调用, 只会增加
+    void set_producers(size_t n);
+    // 合并各 producer 的上下文, 应用所有排队的访问并执行推迟的迁移, 返回应用的样本数
+    size_t drain();
     void delete_entry(uint64_t addr, uint64_t length) override;
+    // 所有 expander 的聚合粒度与总内存上限 (平均分配)
+    void set_tracking(unsigned shift, size_t max_bytes);
     void set_stats(mem_stats stats);
+    void set_free(const alloc_info &info);
     void set_process_info(const proc_info &process_info);
     void set_thread_info(const proc_info &thread_info);
+    // 在摄取开始前调用, 之后迁移/失效策略不再阻塞插入路径
+    void start_scheduler();
+    // 等待后台策略完成并应用剩余计划, 之后回到同步执行
+    void stop_scheduler();
+    // 迁移带宽预算 (MB/s), 0 表示不限
+    void set_migration_budget(double mbps);
     void perform_migration();
+    // 把 addr 所在的 size 字节搬到迁移策略选择的设备, 策略不指定时 expander 上的数据提升到本地层,
+    // 本地层的数据降级到有空间且负载最低的 expander; 由迁移策略或调度器的计划触发
+    void migrate(uint64_t addr, uint64_t size);
+    // migrate 的目标设备, 没有合适的设备时返回 PageDirectory::none
+    int migration_target(uint64_t addr, int src, size_t records);
+    // 设备再放下 records 条记录后不超过其容量
+    bool has_room(int device, size_t records);
+    // 地址当前所在的设备: PageDirectory::local, expander id 或 PageDirectory::none
+    int locate(uint64_t addr);
+    // 本地层或某个 expander 仍持有 phys 所在页的记录
+    bool page_resident(uint64_t phys);
+    OccupationStore &store_of(int device) {
+        return device == PageDirectory::local ? occupation : cur_expanders[device]->occupation;
+    }
     // 添加缓存访问方法
-    std::optional<uint64_t> access_cache(uint64_t addr, uint64_t timestamp) { return lru_cache.get(addr, timestamp); }
+    std::optional<uint64_t> access_cache(uint64_t addr, uint64_t timestamp) { return host_cache.get(addr, timestamp); }
 
     // 添加缓存更新方法
-    void update_cache(uint64_t addr, uint64_t value, uint64_t timestamp) { lru_cache.put(addr, value, timestamp); }
+    void update_cache(uint64_t addr, uint64_t value, uint64_t timestamp) { host_cache.put(addr, value, timestamp); }
     void perform_back_invalidation();
+    void back_invalidate(uint64_t addr);
     void invalidate_in_expanders(uint64_t addr);
     void invalidate_in_switch(CXLSwitch *switch_, uint64_t addr);
+    // 把一次设备访问计入路径上每个交换机的计数和拥塞窗口
+    void charge_path(int device, uint64_t timestamp, uint64_t phys_addr, bool is_write, uint64_t weight);
+    // 把一次 bytes 字节的整块拷贝计入设备和路径上各链路的令牌桶
+    void charge_copy(int device, uint64_t timestamp, uint64_t bytes, bool is_write);
+
+private:
+    // 把样本路由到 ctx; producer < 0 时远程访问直接插入 expander
+    int insert_batch(std::span<const mem_sample> samples, ingest_context &ctx, int producer);
+    // 把上下文中推迟的更新应用到控制器, 返回是否有新的访问
+    bool merge(ingest_context &ctx);
+    void access_local(uint64_t timestamp, uint64_t phys_addr);
+    int access_remote(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr, int device,
+                      int producer, uint64_t weight);
+    void run_policies();
+    bool policies_due() const;
+    // 摄取之后按节奏运行或提交策略
+    void poll_policies();
 };
 
 template <> struct std::formatter<CXLController> {
@@ -324,6 +396,9 @@ template <> struct std::formatter<CXLController> {
         result += std::format("    Local: {}\n", controller.counter.local.get());
         result += std::format("    Remote: {}\n", controller.counter.remote.get());
         result += std::format("    HITM: {}\n", controller.counter.hitm.get());
+        result += std::format("    Migrated bytes: {}\n", controller.migrated_bytes);
+        result += std::format("    Migrations throttled: {}\n", controller.migrations_throttled);
+        result += std::format("    Migrations without room: {}\n", controller.migrations_no_room);
 
         // 打印拓扑结构（交换机和端点）
         result += "Topology:\n";
@@ -364,7 +439,7 @@ template <> struct std::formatter<CXLController> {
         result += "\nStatistics:\n";
         result += std::format("  Number of Switches: {}\n", controller.num_switches);
         result += std::format("  Number of Endpoints: {}\n", controller.num_end_points);
-        result += std::format("  Number of Threads created: {}\n", controller.thread_map.size());
+        result += std::format("  Number of Threads created: {}\n", controller.threads.size());
         result += std::format("  Memory Freed: {} bytes\n", controller.freed);
 
         return format_to(ctx.out(), "{}", result);
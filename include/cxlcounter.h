@@ -57,8 +57,8 @@ public:
     };
 
     // C++26允许constexpr修饰原子操作 (C++26 allows constexpr to modify atomic operations)
-    constexpr void increment() noexcept {
-        value.fetch_add(1, std::memory_order_relaxed);
+    constexpr void increment(uint64_t n = 1) noexcept {
+        value.fetch_add(n, std::memory_order_relaxed);
     }
 
     constexpr uint64_t get() const noexcept {
@@ -129,9 +129,9 @@ public:
         }
     }
 
-    constexpr void inc_load() noexcept { load.increment(); }
-    constexpr void inc_store() noexcept { store.increment(); }
-    constexpr void inc_conflict() noexcept { conflict.increment(); }
+    constexpr void inc_load(uint64_t n = 1) noexcept { load.increment(n); }
+    constexpr void inc_store(uint64_t n = 1) noexcept { store.increment(n); }
+    constexpr void inc_conflict(uint64_t n = 1) noexcept { conflict.increment(n); }
 
     // 使用C++23的auto模板参数实现更灵活的统计功能
     template<auto Field>
@@ -172,8 +172,8 @@ public:
         }
     }
 
-    constexpr void inc_load() noexcept { load.increment(); }
-    constexpr void inc_store() noexcept { store.increment(); }
+    constexpr void inc_load(uint64_t n = 1) noexcept { load.increment(n); }
+    constexpr void inc_store(uint64_t n = 1) noexcept { store.increment(n); }
     constexpr void inc_migrate_in() noexcept { migrate_in.increment(); }
     constexpr void inc_migrate_out() noexcept { migrate_out.increment(); }
     constexpr void inc_hit_old() noexcept { hit_old.increment(); }
@@ -217,9 +217,9 @@ public:
         }
     }
 
-    constexpr void inc_local() noexcept { local.increment(); }
-    constexpr void inc_remote() noexcept { remote.increment(); }
-    constexpr void inc_hitm() noexcept { hitm.increment(); }
+    constexpr void inc_local(uint64_t n = 1) noexcept { local.increment(n); }
+    constexpr void inc_remote(uint64_t n = 1) noexcept { remote.increment(n); }
+    constexpr void inc_hitm(uint64_t n = 1) noexcept { hitm.increment(n); }
     constexpr void inc_backinv() noexcept { backinv.increment(); }
 
     // 便捷方法:计算本地命中率
@@ -14,27 +14,87 @@
 
 #include "cxlcounter.h"
 #include "helper.h"
+#include "bandwidth.h"
+#include "congestion.h"
+#include "fixedring.h"
+#include "occupation.h"
+#include "spscqueue.h"
+#include <array>
+#include <functional>
 #include <list>
+#include <memory>
 #include <queue>
-#include <map>
+#include <mutex>
+#include <shared_mutex>
 #include <tuple>
 #include <unordered_set>
 #include <vector>
 #define ROB_SIZE 512
+#define LBR_WINDOW_SIZE 1024 // 每个线程 LBR 窗口的最大条数, 2 的幂
+#define ACCESS_WINDOW 100000 // get_access 的时间窗口 (ns)
+#define CACHELINE_SIZE 64
+#define INGEST_QUEUE_SIZE 4096 // 每个 producer 每个 expander 的队列长度
+#define SWITCH_LATENCY 200.0 // 默认的交换机延迟 (ns), 对应 congestion_latency 的默认值
 
-struct occupation_info {
-    uint64_t timestamp{};
-    uint64_t address{};
-    uint64_t access_count{};
-};
+enum llcm_kind { LLCM_LOCAL, LLCM_REMOTE, LLCM_KINDS };
 struct rob_info {
-    std::map<int, int64_t> m_bandwidth, m_count;
-    int64_t llcm_base, llcm_count, ins_count;
+    std::array<int64_t, LLCM_KINDS> m_count{}; // ROB 窗口内各类 LLC miss 的数量
+    int64_t llcm_base = 0, llcm_count = 0, ins_count = 0;
+};
+// 采集样本回调 (producer, timestamp, phys_addr, is_write, weight); producer 为入队的采集线程编号
+using sample_sink = std::function<void(size_t, uint64_t, uint64_t, bool, uint64_t)>;
+// 按设备的采集样本回调 (device, producer, timestamp, phys_addr, is_write, weight)
+using device_sink = std::function<void(size_t, size_t, uint64_t, uint64_t, bool, uint64_t)>;
+// 带权访问计数: weight 次访问中只有第一次可能是写
+template <typename C> void count_weighted(C &counter, bool is_write, uint64_t weight) {
+    if (is_write) {
+        counter.inc_store();
+        counter.inc_load(weight - 1);
+    } else {
+        counter.inc_load(weight);
+    }
+}
+// 带权访问占用的带宽, 与 count_weighted 相同地拆分读写
+inline void record_weighted(BandwidthEngine &engine, uint64_t timestamp, bool is_write, uint64_t weight) {
+    if (is_write) {
+        engine.record(timestamp, CACHELINE_SIZE, true);
+        if (weight > 1)
+            engine.record(timestamp, CACHELINE_SIZE * (weight - 1), false);
+    } else {
+        engine.record(timestamp, CACHELINE_SIZE * weight, false);
+    }
+}
+// 连续 count 次相同类型 (0 本地, 1 远程) 的 LLC miss, 带权样本只占一项
+struct llcm_run {
+    int type;
+    int64_t count;
+};
+// ROB 窗口内一条 LBR 记录贡献的指令数和 LLC miss 数
+struct lbr_window_entry {
+    uint32_t ins_count;
+    uint32_t llcm_count;
 };
+// 每个线程固定大小的 ROB 状态, 创建后不再分配内存
+// Fixed-size per-thread ROB state. A ROB window never holds more than ROB_SIZE misses, so ROB_SIZE runs always
+// suffice for llcm_type_rob; pending types that overflow are the oldest ones and are dropped.
 struct thread_info {
+    using runs = FixedRing<llcm_run, ROB_SIZE>;
     rob_info rob;
-    std::queue<int> llcm_type;
-    std::queue<int> llcm_type_rob;
+    runs llcm_type; // PEBS 已分类、尚未被 LBR 消费的 miss
+    runs llcm_type_rob; // 当前 ROB 窗口内的 miss
+    // 该线程自己的 LBR 窗口, rob.ins_count / rob.llcm_count 为窗口内的累加和
+    FixedRing<lbr_window_entry, LBR_WINDOW_SIZE> lbr_window;
+    static void push(runs &ring, int type, int64_t count) {
+        if (count <= 0)
+            return;
+        if (!ring.empty() && ring.back().type == type) {
+            ring.back().count += count;
+            return;
+        }
+        if (ring.full())
+            ring.pop_front();
+        ring.push_back({type, count});
+    }
 };
 // Forward declarations
 class CXLController;
@@ -44,13 +104,15 @@ public:
 
 private:
     virtual void set_epoch(int epoch) = 0;
-    virtual void free_stats(double size) = 0;
+    // 释放 [addr, addr + length) 内的全部条目
+    virtual void free_range(uint64_t addr, uint64_t length) = 0;
     virtual void delete_entry(uint64_t addr, uint64_t length) = 0;
-    virtual double calculate_latency(const std::vector<std::tuple<uint64_t, uint64_t>> &elem,
+    virtual double calculate_latency(uint64_t timestamp,
                                      double dramlatency) = 0; // traverse the tree to calculate the latency
-    virtual double calculate_bandwidth(const std::vector<std::tuple<uint64_t, uint64_t>> &elem) = 0;
-    virtual int insert(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr,
-                       int index) = 0; // 0 not this endpoint, 1 store, 2 load, 3 prefetch
+    virtual double calculate_bandwidth(uint64_t timestamp) = 0;
+    // weight 为该样本代表的访问次数
+    virtual int insert(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr, int index,
+                       uint64_t weight) = 0; // 0 not this endpoint, 1 store, 2 load, 3 prefetch
     virtual std::vector<std::tuple<uint64_t, uint64_t>> get_access(uint64_t timestamp) = 0;
 };
 
@@ -59,13 +121,26 @@ public:
     EmuCXLBandwidth bandwidth{};
     EmuCXLLatency latency{};
     uint64_t capacity;
+    BandwidthEngine bandwidth_engine; // 读写令牌桶, 由 bandwidth 配置
+    // 到上游交换机的链路延迟 (ns) 和带宽 (GB/s), 0 带宽表示不限; uplink 为该链路的令牌桶
+    double link_latency = 0.0;
+    double link_bandwidth = 0.0;
+    BandwidthEngine uplink;
+    void set_link(double latency, double bandwidth);
 
-    std::vector<occupation_info> occupation; // timestamp, pa
-    std::unordered_set<uint64_t> address_cache{};
-    bool cache_valid = false;
+    OccupationStore occupation; // timestamp, pa
     CXLMemExpanderEvent counter{};
     CXLMemExpanderEvent last_counter{};
     mutable std::shared_mutex occupationMutex_; // 使用共享互斥锁允许多个读取者
+    // 并发采集: 每个 producer 一个无锁队列, 队列满时写入加锁的 overflow, 由 drain 统一应用
+    struct ingest_sample {
+        uint64_t timestamp;
+        uint64_t phys_addr;
+        uint64_t weight;
+        size_t producer; // 内存池中据此找到发出访问的主机
+    };
+    std::vector<std::unique_ptr<SPSCQueue<ingest_sample>>> ingest_queues;
+    std::vector<ingest_sample> overflow;
     // LRUCache lru_cache;
     // tlb map and paging map -> invalidate
     int last_read = 0;
@@ -74,78 +149,42 @@ public:
     int epoch = 0;
     uint64_t last_timestamp = 0;
     int id = -1;
-    struct AddressRange {
-        uint64_t start;
-        uint64_t end;
-
-        // 添加比较运算符，用于二分查找
-        bool operator<(const AddressRange& other) const {
-            return end < other.start;
-        }
-
-        bool operator<(uint64_t addr) const {
-            return end < addr;
-        }
-    };
-    std::vector<AddressRange> address_ranges;
 
     CXLMemExpander(int read_bw, int write_bw, int read_lat, int write_lat, int id, int capacity);
     std::vector<std::tuple<uint64_t, uint64_t>> get_access(uint64_t timestamp) override;
     void set_epoch(int epoch) override;
-    void free_stats(double size) override;
-    int insert(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr, int index) override;
-    double calculate_latency(const std::vector<std::tuple<uint64_t, uint64_t>> &elem,
+    void free_range(uint64_t addr, uint64_t length) override;
+    int insert(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr, int index,
+               uint64_t weight = 1) override;
+    // 在 producers 启动前调用, 之后队列数量不再变化
+    void set_producers(size_t n);
+    // 生产者线程调用, 只接触自己的队列
+    void enqueue(size_t producer, uint64_t timestamp, uint64_t phys_addr, uint64_t weight = 1);
+    // 在 epoch 边界把所有队列应用到 occupation, 并把每个样本交给 on_sample
+    size_t drain(const sample_sink &on_sample);
+    double calculate_latency(uint64_t timestamp,
                              double dramlatency) override; // traverse the tree to calculate the latency
-    double calculate_bandwidth(const std::vector<std::tuple<uint64_t, uint64_t>> &elem) override;
+    double calculate_bandwidth(uint64_t timestamp) override;
     void delete_entry(uint64_t addr, uint64_t length) override;
-    void update_address_cache() {
-        if (cache_valid) return;
-        address_cache.clear();
-        for (const auto& occ : occupation)
-            address_cache.insert(occ.address);
-        cache_valid = true;
+    // 按时间窗口流式访问 (timestamp, addr, device), 不产生中间 vector
+    template <typename F> void for_each_access(uint64_t timestamp, F &&f) {
+        std::shared_lock lock(occupationMutex_);
+        occupation.for_each_since(timestamp - ACCESS_WINDOW,
+                                  [&](const occupation_info &it) { f(it.timestamp, it.address, this); });
     }
-    // 当 occupation 更新时调用此函数
-    void invalidate_cache() {
-        cache_valid = false;
+    size_t count_access(uint64_t timestamp) const {
+        std::shared_lock lock(occupationMutex_);
+        return occupation.count_since(timestamp - ACCESS_WINDOW);
     }
+    // 地址索引随 occupation 原地更新, 聚合模式下按所在的页判断
+    bool is_address_local(uint64_t addr) const { return occupation.contains(addr); }
 
-    void update_range_cache() {
-        if (cache_valid) return;
-        address_ranges.clear();
-        // 排序occupation以便合并连续地址
-        std::sort(occupation.begin(), occupation.end(),
-                 [](const auto& a, const auto& b) { return a.address < b.address; });
-        if (occupation.empty()) {
-            cache_valid = true;
-            return;
-        }
-        AddressRange current{occupation[0].address, occupation[0].address};
-        for (size_t i = 1; i < occupation.size(); i++) {
-            if (occupation[i].address == current.end + 1) {
-                // 连续地址，扩展范围
-                current.end = occupation[i].address;
-            } else {
-                // 新范围
-                address_ranges.push_back(current);
-                current = {occupation[i].address, occupation[i].address};
-            }
-        }
-        address_ranges.push_back(current);
-        cache_valid = true;
-    }
-
-    bool is_address_local(uint64_t addr) {
-        if (!cache_valid)
-            update_range_cache();
-        // 使用标准库的二分查找，查找第一个"不小于"addr的元素
-        auto it = std::lower_bound(address_ranges.begin(), address_ranges.end(), addr);
-        // 如果找到了范围，且addr在这个范围内
-        if (it != address_ranges.end() && addr >= it->start && addr <= it->end)
-            return true;
-        return false;
-    }
+private:
+    int apply(uint64_t timestamp, uint64_t phys_addr, uint64_t weight);
 };
+// 各 expander 的队列在独立线程上并行应用到各自的 occupation, 之后在调用线程上按设备顺序把样本交给
+// on_sample, 路径上的交换机由多个 expander 共享, 只在这一步串行计入
+size_t drain_expanders(const std::vector<CXLMemExpander *> &expanders, const device_sink &on_sample);
 class CXLSwitch : public CXLEndPoint {
 public:
     std::vector<CXLMemExpander *> expanders{};
@@ -158,20 +197,42 @@ public:
     std::unordered_map<uint64_t, uint64_t> timeseries_map;
 
     double congestion_latency = 0.02; // 200ns is the latency of the switch
+    // 到上游交换机的链路, 含义与 CXLMemExpander 相同; 根 (控制器) 不使用
+    double link_latency = 0.0;
+    double link_bandwidth = 0.0;
+    BandwidthEngine uplink;
+    // 设置上游链路, 冲突代价随链路延迟缩放
+    void set_link(double latency, double bandwidth);
+    // 子树内的访问样本, 随插入增量维护冲突计数
+    CongestionEngine congestion{ACCESS_WINDOW};
     explicit CXLSwitch(int id);
     std::vector<std::tuple<uint64_t, uint64_t>> get_access(uint64_t timestamp) override;
-    double calculate_latency(const std::vector<std::tuple<uint64_t, uint64_t>> &elem,
+    double calculate_latency(uint64_t timestamp,
                              double dramlatency) override; // traverse the tree to calculate the latency
-    double calculate_bandwidth(const std::vector<std::tuple<uint64_t, uint64_t>> &elem) override;
-    double get_endpoint_rob_latency(CXLMemExpander* endpoint,
-                                  const std::vector<std::tuple<uint64_t, uint64_t>>& accesses,
-                                  const thread_info& t_info,
-                                  double dramlatency);
-    int insert(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr, int index) override;
+    double calculate_bandwidth(uint64_t timestamp) override;
+    // base_latency 为 endpoint 的路径延迟, 由编译后的拓扑给出
+    double get_endpoint_rob_latency(double base_latency, size_t access_count, const thread_info &t_info,
+                                    double dramlatency);
+    // 遍历整棵子树中所有 expander 在时间窗口内的访问
+    template <typename F> void for_each_access(uint64_t timestamp, F &&f) {
+        for (auto *expander : expanders)
+            expander->for_each_access(timestamp, f);
+        for (auto *switch_ : switches)
+            switch_->for_each_access(timestamp, f);
+    }
+    int insert(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr, int index,
+               uint64_t weight = 1) override;
     void delete_entry(uint64_t addr, uint64_t length) override;
-    virtual std::tuple<double, std::vector<uint64_t>> calculate_congestion();
+    void record_congestion(uint64_t timestamp, uint64_t phys_addr, bool is_write, bool track_address,
+                           uint64_t weight = 1);
+    // 应用子树内所有 expander 的采集队列, 并把样本交给拥塞引擎; up 把样本继续向上传给父交换机
+    size_t drain(const sample_sink &up);
+    // 推进拥塞窗口到 timestamp 并返回整棵子树的冲突延迟
+    virtual double calculate_congestion(uint64_t timestamp);
+    // 只推进本交换机的拥塞窗口, 不含子交换机
+    double local_congestion(uint64_t timestamp);
     void set_epoch(int epoch) override;
-    void free_stats(double size) override;
+    void free_range(uint64_t addr, uint64_t length) override;
 };
 
 #endif // CXLMEMSIM_CXLENDPOINT_H
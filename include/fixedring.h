@@ -0,0 +1,51 @@
+/*
+ * CXLMemSim fixed ring
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#ifndef CXLMEMSIM_FIXEDRING_H
+#define CXLMEMSIM_FIXEDRING_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// 固定容量的环形队列, 存储内联在对象中, 不做动态分配
+// Fixed-capacity FIFO stored inline; N must be a power of two. Callers check full() before push_back.
+template <typename T, size_t N> class FixedRing {
+    static_assert((N & (N - 1)) == 0, "FixedRing capacity must be a power of two");
+
+public:
+    bool empty() const { return count == 0; }
+    bool full() const { return count == N; }
+    size_t size() const { return count; }
+    static constexpr size_t capacity() { return N; }
+
+    T &front() { return buffer[head]; }
+    const T &front() const { return buffer[head]; }
+    T &back() { return buffer[(head + count - 1) & (N - 1)]; }
+    const T &back() const { return buffer[(head + count - 1) & (N - 1)]; }
+
+    void push_back(const T &value) {
+        buffer[(head + count) & (N - 1)] = value;
+        count++;
+    }
+    void pop_front() {
+        head = (head + 1) & (N - 1);
+        count--;
+    }
+    void clear() { head = count = 0; }
+
+private:
+    std::array<T, N> buffer{};
+    uint32_t head = 0;
+    uint32_t count = 0;
+};
+
+#endif // CXLMEMSIM_FIXEDRING_H
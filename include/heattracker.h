@@ -0,0 +1,78 @@
+/*
+ * CXLMemSim heat tracker
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#ifndef CXLMEMSIM_HEATTRACKER_H
+#define CXLMEMSIM_HEATTRACKER_H
+
+#include "occupation.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define HEAT_TOP_K 256 // 热点候选数
+#define HEAT_SKETCH_WIDTH 4096 // count-min 每行的计数器数, 取 2 的幂
+#define HEAT_SKETCH_DEPTH 4
+#define HEAT_HALF_LIFE 10000000 // 热度半衰期 (ns)
+
+// 固定内存的热度统计: 指数衰减的 count-min sketch 加 space-saving top-K
+// Page heat with memory fixed at construction. Frequencies go into a count-min sketch with conservative update,
+// and the K hottest pages are kept by space-saving in a min-heap, where a newcomer takes the coldest slot with
+// that slot's count plus its weight, tightened by its sketch estimate. Decay uses forward decay: weights are
+// scaled by 2^((t - landmark) / half_life), so stored counts never need to be aged one by one and only get
+// rescaled when the scale grows large. Listing the hot pages is O(K).
+class HeatTracker {
+public:
+    explicit HeatTracker(size_t top_k = HEAT_TOP_K, size_t width = HEAT_SKETCH_WIDTH,
+                         size_t depth = HEAT_SKETCH_DEPTH, uint64_t half_life = HEAT_HALF_LIFE,
+                         unsigned page_shift = 12);
+
+    // addr 所在的页在 timestamp 时刻被访问 weight 次
+    void record(uint64_t addr, uint64_t timestamp, uint64_t weight = 1);
+    // 页在最近一次记录时刻的衰减热度 (高估)
+    double estimate(uint64_t addr) const;
+    // 热度不低于 threshold 的候选页, 每页给出最近一次访问的地址
+    template <typename F> void for_each_hot(double threshold, F &&f) const {
+        double s = scale(now_), scaled = threshold * s;
+        for (const auto &e : heap) {
+            if (e.count >= scaled)
+                f(e.addr, e.count / s);
+        }
+    }
+    void clear();
+    size_t top_k() const { return capacity; }
+    uint64_t now() const { return now_; }
+
+private:
+    struct entry {
+        uint64_t page;
+        uint64_t addr; // 最近一次访问的地址, 迁移以它定位记录
+        double count; // 按 landmark 缩放后的计数
+    };
+    size_t capacity;
+    size_t width_mask;
+    size_t depth;
+    double half_life;
+    unsigned page_shift;
+    std::vector<double> sketch; // depth 行, 每行 width 个计数器
+    std::vector<entry> heap; // 以 count 为键的最小堆
+    AddressIndex index; // 页 -> heap 下标
+    uint64_t landmark = 0;
+    uint64_t now_ = 0;
+
+    double scale(uint64_t timestamp) const;
+    size_t cell(size_t row, uint64_t page) const;
+    void rescale();
+    void sift_down(size_t i);
+    void sift_up(size_t i);
+    void place(size_t i);
+};
+
+#endif // CXLMEMSIM_HEATTRACKER_H
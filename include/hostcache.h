@@ -0,0 +1,107 @@
+/*
+ * CXLMemSim host cache
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#ifndef CXLMEMSIM_HOSTCACHE_H
+#define CXLMEMSIM_HOSTCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+struct LRUCacheEntry {
+    uint64_t key; // 缓存键（地址）
+                  // Cache key (address)
+    uint64_t value; // 缓存值
+                    // Cache value
+    uint64_t timestamp; // 最后访问时间戳
+                        // Last access timestamp
+};
+
+// 组内标签比较内核, 返回与 key 相等的路的位掩码
+namespace hostcache_kernels {
+uint64_t match(const uint64_t *tags, size_t ways, uint64_t key);
+const char *name();
+} // namespace hostcache_kernels
+
+// 组相联主机缓存模型
+// Set-associative host cache. Tags, values and timestamps are flat arrays indexed by set * ways + way, so a
+// lookup touches one contiguous run of tags that is compared with SIMD. Replacement is per set: true LRU by
+// age ranks, CLOCK with a reference bit and a hand, or 2-bit SRRIP.
+class HostCache {
+public:
+    enum class replacement { LRU, CLOCK, RRIP };
+
+    // entries 为总条目数, 组数向上取整为 2 的幂; ways 最多 64
+    explicit HostCache(size_t entries, unsigned ways = 16, replacement policy = replacement::LRU);
+    static replacement parse(std::string_view name);
+
+    // 获取缓存值，如果存在则更新替换状态
+    // Get cache value, update the replacement state if it exists
+    std::optional<uint64_t> get(uint64_t key, uint64_t timestamp);
+    // 添加或更新缓存, 组满时按替换策略淘汰
+    void put(uint64_t key, uint64_t value, uint64_t timestamp);
+    bool remove(uint64_t key);
+    void clear();
+
+    size_t size() const { return count; }
+    std::tuple<int, int> get_stats() const { return {(int)count, (int)capacity()}; }
+    size_t capacity() const { return sets * ways; }
+    size_t memory_usage() const;
+
+    // 开启后记录被改动过的组, sync_to 只把这些组复制到影子副本
+    void enable_journal();
+    // 把上次同步以来改动过的组复制到 mirror, 第一次或几何形状不同时整体复制; 返回复制的组数
+    size_t sync_to(HostCache &mirror);
+
+    // 遍历所有有效条目 f(key, entry)
+    template <typename F> void for_each(F &&f) const {
+        for (size_t s = 0; s < sets; ++s) {
+            for (uint64_t bits = valid[s]; bits; bits &= bits - 1) {
+                size_t i = s * ways + __builtin_ctzll(bits);
+                f(tags[i], LRUCacheEntry{tags[i], values[i], timestamps[i]});
+            }
+        }
+    }
+
+private:
+    size_t sets;
+    unsigned ways;
+    replacement policy;
+    size_t count = 0;
+    std::vector<uint64_t> tags;
+    std::vector<uint64_t> values;
+    std::vector<uint64_t> timestamps;
+    std::vector<uint8_t> state; // LRU: age rank, CLOCK: reference bit, RRIP: re-reference prediction value
+    std::vector<uint64_t> valid; // per set
+    std::vector<uint8_t> hands; // CLOCK hand per set
+    // 变更日志: dirty 标记去重, 所以 dirty_sets 不超过组数
+    bool journaling = false;
+    bool synced = false;
+    std::vector<uint8_t> dirty;
+    std::vector<uint32_t> dirty_sets;
+
+    void mark(size_t set) {
+        if (journaling && !dirty[set]) {
+            dirty[set] = 1;
+            dirty_sets.push_back(set);
+        }
+    }
+
+    size_t set_of(uint64_t key) const { return (key >> 6) & (sets - 1); }
+    int lookup(size_t set, uint64_t key) const;
+    void touch(size_t set, unsigned way);
+    unsigned victim(size_t set);
+};
+
+#endif // CXLMEMSIM_HOSTCACHE_H
@@ -0,0 +1,277 @@
+/*
+ * CXLMemSim occupation store
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#ifndef CXLMEMSIM_OCCUPATION_H
+#define CXLMEMSIM_OCCUPATION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <optional>
+#include <utility>
+#include <vector>
+
+struct occupation_info {
+    uint64_t timestamp{};
+    uint64_t address{};
+    uint64_t access_count{};
+    uint64_t reads{};
+    uint64_t writes{};
+};
+
+// 开放寻址哈希表 (线性探测 + 反向移位删除), 地址 -> 环形缓冲区序号
+// Open addressing hash map (linear probing + backward shift deletion), address -> ring sequence
+class AddressIndex {
+public:
+    static constexpr uint64_t npos = UINT64_MAX;
+
+    AddressIndex() = default;
+    uint64_t find(uint64_t key) const;
+    void insert_or_assign(uint64_t key, uint64_t value);
+    bool erase(uint64_t key);
+    void clear();
+    void reserve(size_t n);
+    size_t size() const { return count; }
+
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+private:
+    struct slot {
+        uint64_t key{};
+        uint64_t value = npos; // npos marks an empty slot
+    };
+    std::vector<slot> slots;
+    size_t mask = 0;
+    size_t count = 0;
+    void rehash(size_t new_capacity);
+};
+
+// 合并相邻地址的区间集合, 插入/删除/合并都是 O(log n) 并原地更新
+// Set of inclusive address ranges; adjacent addresses coalesce, and insert, erase and lookups are O(log n)
+class AddressRangeSet {
+public:
+    AddressRangeSet() = default;
+    void insert(uint64_t addr);
+    void erase(uint64_t addr);
+    bool contains(uint64_t addr) const;
+    bool overlaps(uint64_t start, uint64_t end) const;
+    // 按地址升序访问 [lo, hi] 内的每个地址; 区间内的地址都存在, 所以开销为 O(log n + k)
+    template <typename F> void for_each_in(uint64_t lo, uint64_t hi, F &&f) const {
+        auto it = ranges.upper_bound(lo);
+        if (it != ranges.begin() && std::prev(it)->second >= lo)
+            --it;
+        for (; it != ranges.end() && it->first <= hi; ++it) {
+            uint64_t end = std::min(it->second, hi);
+            for (uint64_t addr = std::max(it->first, lo);; ++addr) {
+                f(addr);
+                if (addr == end)
+                    break;
+            }
+        }
+    }
+    void clear() { ranges.clear(); }
+    size_t size() const { return ranges.size(); }
+    bool empty() const { return ranges.empty(); }
+    auto begin() const { return ranges.begin(); }
+    auto end() const { return ranges.end(); }
+
+private:
+    std::map<uint64_t, uint64_t> ranges; // start -> end (inclusive)
+};
+
+// 窗口过滤内核, 运行时按 CPU 选择 AVX-512 / AVX2 / 标量实现
+// Filter kernels over the store's column arrays, dispatched at runtime to AVX-512, AVX2 or scalar code.
+// select_since writes the indices of matching live slots to out (room for n) and return how many matched.
+namespace occupation_kernels {
+size_t select_since(const uint64_t *timestamps, const uint8_t *live, size_t n, uint64_t after, uint32_t *out);
+size_t count_since(const uint64_t *timestamps, const uint8_t *live, size_t n, uint64_t after);
+const char *name();
+} // namespace occupation_kernels
+
+// 按时间排序的环形缓冲区 + 地址索引, 列式存储
+// Time-ordered ring of occupation_info plus an address index. Re-accessing an address tombstones its old slot
+// and appends at the tail, so updates are O(1) amortized and a time window is found by binary search over the
+// prefix-max timestamp, costing O(log n + window) instead of a full scan. Fields are kept as separate arrays so
+// the window filters run as SIMD kernels over contiguous columns. The address range set doubles as an
+// address-ordered secondary index, so range queries cost O(log n + k).
+class OccupationStore {
+public:
+    OccupationStore() = default;
+
+    class iterator {
+    public:
+        iterator(const OccupationStore *store, uint64_t seq) : store(store), seq(seq) { skip(); }
+        occupation_info operator*() const { return store->info(store->slot(seq)); }
+        iterator &operator++() {
+            ++seq;
+            skip();
+            return *this;
+        }
+        bool operator==(const iterator &other) const { return seq == other.seq; }
+        bool operator!=(const iterator &other) const { return seq != other.seq; }
+
+    private:
+        const OccupationStore *store;
+        uint64_t seq;
+        void skip() {
+            while (seq < store->tail && !store->live[store->slot(seq)])
+                ++seq;
+        }
+    };
+
+    iterator begin() const { return {this, head}; }
+    iterator end() const { return {this, tail}; }
+    size_t size() const { return live_count; }
+    bool empty() const { return live_count == 0; }
+    bool contains(uint64_t address) const { return index.find(key(address)) != AddressIndex::npos; }
+    std::optional<occupation_info> find(uint64_t address) const;
+    const AddressRangeSet &ranges() const { return address_ranges; }
+    bool overlaps(uint64_t lo, uint64_t hi) const { return address_ranges.overlaps(key(lo), key(hi)); }
+
+    // 聚合粒度与内存上限: shift 为 0 时按地址精确记录, 12 为页, 21 为大页
+    // Track records at 1 << shift granularity and keep at most max_bytes of them (0 means unbounded); when the
+    // ceiling is hit the least recently touched record is evicted. Changing the granularity drops the contents.
+    void configure(unsigned shift, size_t max_bytes);
+    uint64_t key(uint64_t address) const { return address >> granularity_shift << granularity_shift; }
+    size_t memory_usage() const { return live_count * entry_bytes; }
+    uint64_t evicted() const { return evicted_count; }
+
+    // 记录一次访问并累加访问次数与读写计数; 返回记录之前是否已存在
+    // Aggregate one access into its record (count, last timestamp, read/write split) and move it to the tail.
+    // A weighted sample counts as weight accesses of which only the first can be a write, exactly as if they had
+    // been recorded one by one. Returns whether the record was already present.
+    bool record(uint64_t address, uint64_t timestamp, bool is_write, uint64_t weight = 1);
+    // 覆盖访问次数, 保留读写计数; 地址已存在时移动到队尾
+    bool touch(uint64_t address, uint64_t timestamp, uint64_t access_count);
+    bool insert(const occupation_info &info);
+    bool erase(uint64_t address);
+    // 删除与 [lo, hi] 重叠的所有记录, 返回删除的条数; 经由地址区间集合, O(log n + k)
+    size_t erase_range(uint64_t lo, uint64_t hi);
+    void clear();
+
+    // 变更日志: 每个订阅者 (影子副本) 有自己的游标, 同步时只重放游标之后改动过的键
+    // Change journal for mirrors. Every insert, move and removal appends its key; a subscriber replays the keys
+    // past its cursor against the current contents, so keeping a mirror current costs O(changes), not O(size).
+    // The journal keeps at most about twice the live entries; a subscriber that falls behind that is resynced
+    // with a full copy, which costs no more than the changes it missed.
+    size_t subscribe();
+    void unsubscribe(size_t reader);
+    // 把订阅者 reader 上次同步以来的改动应用到 mirror, 返回重放的键数 (整体复制时为条目数)
+    size_t sync_to(OccupationStore &mirror, size_t reader);
+
+    // 遍历时间戳严格大于 timestamp 的条目
+    // Visit every entry with timestamp strictly greater than the given one
+    template <typename F> void for_each_since(uint64_t timestamp, F &&f) const {
+        visit(lower_bound(timestamp), f, [&](size_t begin, size_t n, uint32_t *out) {
+            return occupation_kernels::select_since(&timestamps[begin], &live[begin], n, timestamp, out);
+        });
+    }
+    size_t count_since(uint64_t timestamp) const;
+    // 从最老的条目开始, 遍历前缀最大时间戳不超过 timestamp 的条目, 开销只与访问到的条目数成正比
+    // Visit the oldest entries, up to the first one whose prefix-max timestamp exceeds the given one. A record
+    // that arrived out of order behind a newer one is reached once that newer one ages as well.
+    template <typename F> void for_each_until(uint64_t timestamp, F &&f) const {
+        for (uint64_t seq = head, end = lower_bound(timestamp); seq < end; ++seq) {
+            size_t i = slot(seq);
+            if (live[i])
+                f(info(i));
+        }
+    }
+    // 遍历地址落在 [lo, hi] 内的条目, 经由按地址有序的区间集合, O(log n + k)
+    template <typename F> void for_each_in_range(uint64_t lo, uint64_t hi, F &&f) const {
+        address_ranges.for_each_in(key(lo), key(hi),
+                                   [&](uint64_t address) { f(info(slot(index.find(address)))); });
+    }
+
+    template <typename P> size_t erase_if(P &&pred) {
+        size_t removed = 0;
+        for (uint64_t seq = head; seq < tail; ++seq) {
+            size_t i = slot(seq);
+            if (live[i] && pred(info(i))) {
+                kill(i);
+                removed++;
+            }
+        }
+        pop_dead();
+        return removed;
+    }
+
+private:
+    static constexpr size_t chunk = 256;
+    // 每条记录的大致内存占用: 列 + 哈希槽 + 区间集合节点, 按 2 倍环形缓冲区余量估算
+    static constexpr size_t entry_bytes = 2 * (6 * sizeof(uint64_t) + 1) + 2 * 2 * sizeof(uint64_t) + 64;
+    // 列式存储, 下标为 seq & mask
+    std::vector<uint64_t> timestamps;
+    std::vector<uint64_t> addresses;
+    std::vector<uint64_t> access_counts;
+    std::vector<uint64_t> reads;
+    std::vector<uint64_t> writes;
+    std::vector<uint64_t> max_timestamps; // prefix max of timestamps up to this slot, monotone over the ring
+    std::vector<uint8_t> live;
+    size_t capacity = 0;
+    size_t mask = 0;
+    uint64_t head = 0; // sequence numbers grow monotonically, slot = seq & mask
+    uint64_t tail = 0;
+    size_t live_count = 0;
+    AddressIndex index;
+    AddressRangeSet address_ranges;
+    unsigned granularity_shift = 0;
+    size_t max_entries = 0; // 0 表示不限制
+    uint64_t evicted_count = 0;
+    static constexpr uint64_t unsynced = UINT64_MAX; // 尚未同步过的订阅者
+    static constexpr uint64_t detached = UINT64_MAX - 1; // 已退订
+    std::deque<uint64_t> journal; // journal[i] 的序号为 journal_base + i
+    uint64_t journal_base = 0;
+    std::vector<uint64_t> journal_cursors; // 每个订阅者下一个要重放的序号
+    size_t journal_readers = 0;
+
+    void log(uint64_t address) {
+        if (!journal_readers)
+            return;
+        journal.push_back(address);
+        if (journal.size() > std::max<size_t>(2 * live_count, 4096))
+            trim_journal(journal.size() / 2);
+    }
+    void trim_journal(size_t n);
+
+    size_t slot(uint64_t seq) const { return seq & mask; }
+    occupation_info info(size_t i) const {
+        return {timestamps[i], addresses[i], access_counts[i], reads[i], writes[i]};
+    }
+    // 环形区间最多拆成两段连续内存, 每段再按 chunk 交给内核过滤
+    template <typename F, typename S> void visit(uint64_t from, F &f, S &&select) const {
+        uint32_t selected[chunk];
+        for (uint64_t seq = from; seq < tail;) {
+            size_t begin = slot(seq);
+            size_t n = std::min<uint64_t>({tail - seq, capacity - begin, chunk});
+            size_t k = select(begin, n, selected);
+            for (size_t j = 0; j < k; ++j)
+                f(info(begin + selected[j]));
+            seq += n;
+        }
+    }
+    uint64_t lower_bound(uint64_t timestamp) const;
+    bool place(const occupation_info &next);
+    void kill(size_t i);
+    void pop_dead();
+    void make_room();
+};
+
+#endif // CXLMEMSIM_OCCUPATION_H
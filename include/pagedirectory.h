@@ -0,0 +1,84 @@
+/*
+ * CXLMemSim page directory
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#ifndef CXLMEMSIM_PAGEDIRECTORY_H
+#define CXLMEMSIM_PAGEDIRECTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+// 物理页 -> 持有该页记录的设备集合
+// Directory from physical page to the devices holding records of it. Lines of one page can be placed on
+// different devices, so each page keeps a bitmask: bit 0 is the controller's local tier, bit id + 1 is expander
+// id, and the last bit stands for every expander past the first 62. Bits are set on insert and cleared lazily
+// by prune, so a lookup always verifies its candidates against the stores.
+class PageDirectory {
+public:
+    static constexpr int local = -1;
+    static constexpr int none = -2;
+
+    explicit PageDirectory(unsigned page_shift = 12) : page_shift(page_shift) {}
+
+    void add(uint64_t addr, int device) { pages[page(addr)] |= bit(device); }
+    void erase_page(uint64_t addr) { pages.erase(page(addr)); }
+    void clear() { pages.clear(); }
+    size_t size() const { return pages.size(); }
+    uint64_t page_size() const { return 1ULL << page_shift; }
+
+    // 依次访问 addr 所在页的候选设备, f 返回 true 时停止并返回该设备
+    // Visit the candidate devices of the page holding addr until f returns true; returns that device or none
+    template <typename F> int find(uint64_t addr, int num_devices, F &&f) const {
+        auto it = pages.find(page(addr));
+        if (it == pages.end())
+            return none;
+        for (uint64_t bits = it->second; bits; bits &= bits - 1) {
+            int b = __builtin_ctzll(bits);
+            int first = b - 1, last = b == overflow_bit ? num_devices - 1 : b - 1;
+            for (int device = first; device <= last; ++device) {
+                if (f(device))
+                    return device;
+            }
+        }
+        return none;
+    }
+    // 清除不再持有该页任何记录的设备位, holds_page(device) 判断设备是否仍持有该页
+    template <typename F> void prune(uint64_t addr, int num_devices, F &&holds_page) {
+        auto it = pages.find(page(addr));
+        if (it == pages.end())
+            return;
+        uint64_t keep = 0;
+        for (uint64_t bits = it->second; bits; bits &= bits - 1) {
+            int b = __builtin_ctzll(bits);
+            int first = b - 1, last = b == overflow_bit ? num_devices - 1 : b - 1;
+            for (int device = first; device <= last; ++device) {
+                if (holds_page(device)) {
+                    keep |= 1ULL << b;
+                    break;
+                }
+            }
+        }
+        if (keep)
+            it->second = keep;
+        else
+            pages.erase(it);
+    }
+
+private:
+    static constexpr int overflow_bit = 63;
+    unsigned page_shift;
+    std::unordered_map<uint64_t, uint64_t> pages;
+
+    uint64_t page(uint64_t addr) const { return addr >> page_shift; }
+    static uint64_t bit(int device) { return 1ULL << (device + 1 < overflow_bit ? device + 1 : overflow_bit); }
+};
+
+#endif // CXLMEMSIM_PAGEDIRECTORY_H
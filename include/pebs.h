@@ -27,6 +27,8 @@ public:
     size_t rdlen{};
     size_t mplen{};
     perf_event_mmap_page *mp;
+    int producer = -1; // >= 0 时在独立线程中读取, 通过 insert_concurrent 写入
+    std::vector<mem_sample> batch; // 一次 read 解码出的采样, 读完后整批交给 controller
     PEBS(pid_t, uint64_t);
     ~PEBS();
     int read(CXLController *, PEBSElem *);
@@ -13,80 +13,96 @@
 #define CXLMEMSIM_POLICY_H
 #include "cxlcontroller.h"
 #include "cxlendpoint.h"
+#include "heattracker.h"
 #include "helper.h"
 #include <map>
+#include <mutex>
 #include <random>
 
+#define INTERLEAVE_MAX_WEIGHT 16 // 最快设备的交错权重, 其余按带宽/延迟比例缩放
+#define NUMA_REFRESH_INTERVAL 100000 // 重新估计负载延迟的间隔 (ns), 与 ACCESS_WINDOW 相同
+#define NUMA_MAX_UTILIZATION 0.95 // 利用率上限, 避免 1 / (1 - u) 发散
+#define NUMA_PLACEMENT_CACHE (1 << 20) // 缓存的页数上限, 超过后清空
+
 // Saturate Local 90% and start interleave accrodingly the remote with topology
-// Say 3 remote, 2 200ns, 1 400ns, will give 40% 40% 20%
+// 加权交错, 与 Linux weighted interleave 相同: 每个设备连续分配 weight 次后轮到下一个
+// Weighted interleave. Each attached expander gets an integer weight from its bandwidth over its path latency,
+// and the weights are laid out as runs of slots, so picking the next device is one table lookup. A device that
+// is full is skipped as a whole run; when every expander is full the allocation spills back to local memory.
 class InterleavePolicy : public AllocationPolicy {
 
 public:
     InterleavePolicy() = default;
-    int last_remote = 0;
-    int all_size = 0;
-    std::vector<double> percentage;
+    std::vector<int> devices; // 参与交错的设备 id
+    std::vector<uint32_t> weights;
+    std::vector<uint32_t> cumulative; // cumulative[i] 为 devices[i] 的第一个槽, 末项为槽总数
+    std::vector<uint32_t> slot_owner; // 槽 -> devices 下标
+    std::vector<uint64_t> limits; // 每个设备未满时 occupation 的记录数上限
+    uint64_t local_limit = 0; // 本地层达到该记录数后开始交错
+    uint32_t cursor = 0;
     int compute_once(CXLController *) override;
+    // 拓扑或页类型变化时重建权重表
+    void build(CXLController *);
+
+private:
+    bool built = false;
+    page_type built_for = PAGE;
 };
 
+// 负载感知的 NUMA 放置: 本地层未满时放本地, 否则放到预期负载延迟最低的 expander
+// Loaded-latency placement. Once per refresh interval of trace time every attached expander gets an expected
+// latency: its path latency inflated by 1 / (1 - u), where u is the bandwidth utilization measured from its
+// counters since the last refresh, plus the queueing delay currently left in its token buckets and uplinks.
+// The preferred device only changes when another one is better by the hysteresis margin, and each page keeps
+// the device it was first placed on, so a placement is one hash lookup.
 class NUMAPolicy : public AllocationPolicy {
 
 public:
-    NUMAPolicy() = default;
-    std::vector<double> latency_scores; // 存储每个节点的延迟评分
+    explicit NUMAPolicy(double hysteresis = 0.1, uint64_t refresh_interval = NUMA_REFRESH_INTERVAL)
+        : hysteresis(hysteresis), refresh_interval(refresh_interval) {}
+    double hysteresis; // 新设备至少要快这个比例才替换当前设备
+    uint64_t refresh_interval;
+    std::vector<double> loaded_latency; // 按设备 id, 未挂在树上的设备为无穷大
+    int preferred = -1;
     int compute_once(CXLController *) override;
+    int place(CXLController *, uint64_t timestamp, uint64_t phys_addr) override;
+    // 用 timestamp 时刻的计数器和令牌桶重新估计负载延迟
+    void refresh(CXLController *, uint64_t timestamp);
+
+private:
+    std::unordered_map<uint64_t, int> placement; // 页号 -> 设备
+    std::vector<uint64_t> last_accesses; // 上次估计时各设备的 load + store
+    std::vector<uint64_t> limits; // 按设备 id, 未满时 occupation 的记录数上限
+    uint64_t local_limit = 0;
+    uint64_t last_refresh = 0;
+    bool refreshed = false;
+    bool full(CXLController *, int device) const;
+    // 到期时先重新估计, 本地层未满放本地, 否则按负载延迟选设备
+    int decide(CXLController *, uint64_t timestamp);
+    int choose(CXLController *);
 };
 
+// 热点迁移: 摄取时增量更新衰减热度, 只在 top-K 候选中挑选热度超过阈值且不在本地的页
+// Hot-page promotion. Heat is fed from ingest through observe_access into a fixed-size HeatTracker, so
+// picking migration candidates scans only the top-K entries instead of the whole occupation.
 class HeatAwareMigrationPolicy : public MigrationPolicy {
-public:
-    std::unordered_map<uint64_t, uint64_t> access_count; // 地址到访问次数的映射
-    uint64_t hot_threshold; // 热点数据阈值
-
-    HeatAwareMigrationPolicy(uint64_t threshold = 100) : hot_threshold(threshold) {}
+    // observe_access 在摄取线程上调用, get_migration_list 可能在调度器线程上调用
+    mutable std::mutex mutex_;
+    HeatTracker heat;
 
-    // 记录访问以跟踪热点数据
-    void record_access(uint64_t addr) { access_count[addr]++; }
-
-    int compute_once(CXLController *controller) override {
-        // 更新访问计数
-        for (const auto &[timestamp, info] : controller->occupation) {
-            record_access(info.address);
-        }
-
-        // 检查是否有热点数据需要迁移
-        auto migration_list = get_migration_list(controller);
-        return migration_list.empty() ? 0 : 1;
-    }
+public:
+    uint64_t hot_threshold; // 热点数据阈值, 按衰减后的访问次数计
 
-    std::vector<std::tuple<uint64_t, uint64_t>> get_migration_list(CXLController *controller) {
-        std::vector<std::tuple<uint64_t, uint64_t>> to_migrate;
+    explicit HeatAwareMigrationPolicy(uint64_t threshold = 100, size_t top_k = HEAT_TOP_K,
+                                      uint64_t half_life = HEAT_HALF_LIFE)
+        : heat(top_k, HEAT_SKETCH_WIDTH, HEAT_SKETCH_DEPTH, half_life), hot_threshold(threshold) {}
 
-        // 定义页面大小
-        int per_size;
-        switch (controller->page_type_) {
-        case CACHELINE:
-            per_size = 64;
-            break;
-        case PAGE:
-            per_size = 4096;
-            break;
-        case HUGEPAGE_2M:
-            per_size = 2 * 1024 * 1024;
-            break;
-        case HUGEPAGE_1G:
-            per_size = 1024 * 1024 * 1024;
-            break;
-        };
+    void observe_access(uint64_t addr, uint64_t timestamp, uint64_t weight) override;
+    // 页在最近一次记录时刻的衰减热度
+    double heat_of(uint64_t addr) const;
 
-        // 检查热点数据
-        for (const auto &[addr, count] : access_count) {
-            if (count > hot_threshold) {
-                // 添加到迁移列表
-                to_migrate.emplace_back(addr, per_size);
-            }
-        }
-        return to_migrate;
-    }
+    int compute_once(CXLController *controller) override;
+    std::vector<std::tuple<uint64_t, uint64_t>> get_migration_list(CXLController *controller) override;
 };
 
 class HugePagePolicy : public PagingPolicy {
@@ -251,7 +267,7 @@ public:
         size_t potential_huge_pages = 0;
 
         // 分析当前的内存访问，按照潜在的大页边界进行分组
-        for (const auto &[timestamp, info] : controller->occupation) {
+        for (const auto &info : controller->occupation) {
             uint64_t addr = info.address;
 
             // 计算2MB大页边界（地址的低21位设为0）
@@ -423,13 +439,8 @@ class FIFOPolicy : public CachingPolicy {
 public:
     FIFOPolicy() = default;
     int compute_once(CXLController *) override;
-    std::vector<uint64_t> get_invalidation_list(CXLController *controller) override {
-        std::vector<uint64_t> to_invalidate;
-        for (const auto &[timestamp, info] : controller->occupation) {
-            to_invalidate.push_back(info.address);
-        }
-        return to_invalidate;
-    };
+    // 缓存满时失效最早插入的条目; 只读取 controller, 可以在调度器的快照上运行
+    std::vector<uint64_t> get_invalidation_list(CXLController *controller) override;
     bool should_cache(uint64_t addr, uint64_t timestamp) override {
         return false;
     };
@@ -440,6 +451,10 @@ public:
 
 // 基于访问频率的后向失效策略
 class FrequencyBasedInvalidationPolicy : public CachingPolicy {
+    // should_cache 在摄取线程上调用, get_invalidation_list 可能在调度器线程上调用
+    std::mutex mutex_;
+    bool below_threshold(uint64_t addr) const;
+
 public:
     std::unordered_map<uint64_t, uint64_t> access_count; // 地址到访问计数的映射
     uint64_t access_threshold; // 访问阈值
@@ -474,7 +489,7 @@ public:
 
     int compute_once(CXLController *controller) override {
         // 更新访问计数
-        for (const auto &[timestamp, info] : controller->occupation) {
+        for (const auto &info : controller->occupation) {
             record_access(info.address);
         }
 
@@ -511,7 +526,7 @@ public:
         };
 
         // 从控制器中查找冷数据
-        for (const auto &[timestamp, info] : controller->occupation) {
+        for (const auto &info : controller->occupation) {
             uint64_t addr = info.address;
             if (access_count[addr] < cold_threshold) {
                 // 冷数据，可以考虑迁移到远程内存
@@ -530,28 +545,11 @@ public:
             }
         };
 
-        // 收集直接连接的扩展器中的热数据
-        for (auto expander : controller->expanders) {
-            collect_hot_data(expander);
+        // 收集拓扑中所有扩展器的热数据, 每个扩展器只访问一次
+        for (int d : controller->topology.devices()) {
+            collect_hot_data(controller->cur_expanders[d]);
         }
 
-        // 递归收集子交换机下的扩展器中的热数据
-        std::function<void(CXLSwitch *)> collect_from_switch = [&collect_hot_data,
-                                                                &collect_from_switch](CXLSwitch *sw) {
-            if (!sw)
-                return;
-
-            for (auto expander : sw->expanders) {
-                collect_hot_data(expander);
-            }
-
-            for (auto child_sw : sw->switches) {
-                collect_from_switch(child_sw);
-            }
-        };
-
-        collect_from_switch(controller);
-
         return to_migrate;
     }
 };
@@ -584,29 +582,13 @@ public:
 
         std::vector<DeviceLoad> expander_loads;
 
-        // 收集直接连接的扩展器的负载
-        for (auto expander : controller->expanders) {
+        // 收集拓扑中所有扩展器的负载
+        for (int d : controller->topology.devices()) {
+            auto *expander = controller->cur_expanders[d];
             uint64_t load = expander->counter.load + expander->counter.store;
             expander_loads.push_back({expander, load});
         }
 
-        // 递归收集所有子交换机下的扩展器的负载
-        std::function<void(CXLSwitch *)> collect_loads = [&expander_loads, &collect_loads](CXLSwitch *sw) {
-            if (!sw)
-                return;
-
-            for (auto expander : sw->expanders) {
-                uint64_t load = expander->counter.load + expander->counter.store;
-                expander_loads.push_back({expander, load});
-            }
-
-            for (auto child_sw : sw->switches) {
-                collect_loads(child_sw);
-            }
-        };
-
-        collect_loads(controller);
-
         if (expander_loads.empty()) {
             return 0; // 没有扩展器
         }
@@ -667,27 +649,10 @@ public:
             expander_loads.push_back({expander, load});
         };
 
-        // 直接连接的扩展器
-        for (auto expander : controller->expanders) {
-            collect_all_loads(expander);
+        for (int d : controller->topology.devices()) {
+            collect_all_loads(controller->cur_expanders[d]);
         }
 
-        // 递归收集子交换机的扩展器
-        std::function<void(CXLSwitch *)> collect_loads = [&collect_all_loads, &collect_loads](CXLSwitch *sw) {
-            if (!sw)
-                return;
-
-            for (auto expander : sw->expanders) {
-                collect_all_loads(expander);
-            }
-
-            for (auto child_sw : sw->switches) {
-                collect_loads(child_sw);
-            }
-        };
-
-        collect_loads(controller);
-
         if (expander_loads.empty()) {
             return to_migrate; // 没有扩展器
         }
@@ -750,7 +715,7 @@ public:
 
     int compute_once(CXLController *controller) override {
         // 更新访问模式
-        for (const auto &[timestamp, info] : controller->occupation) {
+        for (const auto &info : controller->occupation) {
             record_access(info.address);
         }
 
@@ -768,13 +733,7 @@ public:
                 // 有局部性模式，考虑迁移
 
                 // 查找此页面当前所在的设备
-                bool in_controller = false;
-                for (const auto &[timestamp, info] : controller->occupation) {
-                    if ((info.address & ~(page_size - 1)) == page_addr) {
-                        in_controller = true;
-                        break;
-                    }
-                }
+                bool in_controller = controller->occupation.overlaps(page_addr, page_addr + page_size - 1);
 
                 if (!in_controller) {
                     // 页面不在控制器中，可以考虑迁移到控制器
@@ -822,12 +781,13 @@ public:
 
         uint64_t current_time = controller->last_timestamp;
 
-        // 从控制器中查找生命周期较长的数据
-        for (const auto &[timestamp, info] : controller->occupation) {
-            if (current_time - timestamp > lifetime_threshold) {
-                // 生命周期较长的数据，可以考虑迁移到远程内存
-                to_migrate.emplace_back(info.address, per_size);
-            }
+        // 从控制器中查找生命周期较长的数据, 只访问最老的一段
+        if (current_time > lifetime_threshold) {
+            controller->occupation.for_each_until(current_time - lifetime_threshold - 1,
+                                                  [&](const occupation_info &info) {
+                                                      // 生命周期较长的数据，可以考虑迁移到远程内存
+                                                      to_migrate.emplace_back(info.address, per_size);
+                                                  });
         }
 
         return to_migrate;
@@ -844,6 +804,11 @@ public:
     // 添加策略
     void add_policy(MigrationPolicy *policy) { policies.push_back(policy); }
 
+    void observe_access(uint64_t addr, uint64_t timestamp, uint64_t weight) override {
+        for (auto policy : policies)
+            policy->observe_access(addr, timestamp, weight);
+    }
+
     int compute_once(CXLController *controller) override {
         int result = 0;
 
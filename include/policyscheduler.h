@@ -0,0 +1,80 @@
+/*
+ * CXLMemSim policy scheduler
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#ifndef CXLMEMSIM_POLICYSCHEDULER_H
+#define CXLMEMSIM_POLICYSCHEDULER_H
+
+#include "cxlcontroller.h"
+#include "spscqueue.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#define POLICY_PLAN_QUEUE_SIZE 65536
+
+// 后台策略产生的一条计划, 由控制器在摄取线程上应用
+struct policy_plan {
+    enum kind_t : uint8_t { MIGRATE, INVALIDATE } kind;
+    uint64_t addr;
+    uint64_t size;
+};
+
+// 异步策略调度器
+// Runs the migration and caching policies on a background thread against a snapshot of the controller taken
+// at an epoch boundary, and returns the resulting plans through a lock-free queue. The snapshot is a mirror
+// kept current from the change journals of the occupation stores and the host cache, so while the worker is
+// idle the ingestion thread only replays what changed since the last snapshot, and a policy scan never
+// stalls it.
+class PolicyScheduler {
+public:
+    PolicyScheduler(CXLController *controller, policy_cadence cadence);
+    ~PolicyScheduler();
+    PolicyScheduler(const PolicyScheduler &) = delete;
+    PolicyScheduler &operator=(const PolicyScheduler &) = delete;
+    // 摄取线程在 epoch 边界调用: 应用已完成的计划, 到期的策略提交新快照; 返回应用的计划数
+    size_t poll(uint64_t samples, uint64_t timestamp);
+    // 等待进行中的策略完成并应用其计划
+    size_t flush();
+
+private:
+    enum slot { MIGRATION, CACHING, SLOTS };
+    struct schedule {
+        uint64_t samples = 0; // 上次运行以来的访问数
+        uint64_t last_run = 0;
+    };
+    CXLController *controller;
+    policy_cadence default_cadence;
+    std::array<schedule, SLOTS> schedules{};
+    // 与 controller 同构的影子控制器, 只在 worker 空闲时由摄取线程改写
+    std::unique_ptr<CXLController> snapshot;
+    std::vector<std::unique_ptr<CXLMemExpander>> snapshot_expanders;
+    // 本地层和各 expander 占用记录的日志订阅号
+    size_t local_reader = 0;
+    std::vector<size_t> expander_readers;
+    SPSCQueue<policy_plan> plans{POLICY_PLAN_QUEUE_SIZE};
+    std::mutex mutex;
+    std::condition_variable_any cv;
+    unsigned due_mask = 0; // 由 mutex 保护
+    std::atomic<bool> busy{false};
+    std::jthread worker; // 最后声明, 析构时最先停止
+
+    Policy *policy_of(int s) const;
+    bool is_due(int s, uint64_t timestamp) const;
+    void take_snapshot(unsigned mask);
+    void run(std::stop_token stop);
+    void emit(const policy_plan &plan, const std::stop_token &stop);
+    size_t apply();
+};
+
+#endif // CXLMEMSIM_POLICYSCHEDULER_H
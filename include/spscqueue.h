@@ -0,0 +1,65 @@
+/*
+ * CXLMemSim spsc queue
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#ifndef CXLMEMSIM_SPSCQUEUE_H
+#define CXLMEMSIM_SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 有界无锁单生产者单消费者队列
+// Bounded lock-free single-producer single-consumer ring. The consumer side may move between threads as long
+// as consumers are serialized by a lock, which is how expanders drain it.
+template <typename T> class SPSCQueue {
+public:
+    explicit SPSCQueue(size_t capacity) {
+        size_t cap = 1;
+        while (cap < capacity)
+            cap <<= 1;
+        buffer.resize(cap);
+        mask = cap - 1;
+    }
+
+    bool try_push(const T &value) {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        if (t - head_cache == buffer.size()) {
+            head_cache = head.load(std::memory_order_acquire);
+            if (t - head_cache == buffer.size())
+                return false; // 队列已满
+        }
+        buffer[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 取出当前可见的全部元素
+    template <typename F> size_t consume_all(F &&f) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        uint64_t t = tail.load(std::memory_order_acquire);
+        for (uint64_t i = h; i != t; ++i)
+            f(buffer[i & mask]);
+        head.store(t, std::memory_order_release);
+        return t - h;
+    }
+
+    size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+
+private:
+    std::vector<T> buffer;
+    size_t mask = 0;
+    alignas(64) std::atomic<uint64_t> head{0}; // 消费者写
+    alignas(64) std::atomic<uint64_t> tail{0}; // 生产者写
+    uint64_t head_cache = 0; // 生产者缓存的 head, 减少跨核读取
+};
+
+#endif // CXLMEMSIM_SPSCQUEUE_H
@@ -0,0 +1,66 @@
+/*
+ * CXLMemSim topology
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#ifndef CXLMEMSIM_TOPOLOGY_H
+#define CXLMEMSIM_TOPOLOGY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+class CXLSwitch;
+class CXLMemExpander;
+
+// 编译后的拓扑: construct_topo 之后把交换机树展平成数组, 热路径按设备 id 直接索引
+// The switch tree flattened once after construct_topo. Switches are numbered in post-order, so children come
+// before their parent and the root is last. Every device keeps, in CSR form, the ids of the switches from its
+// parent up to the root, the bandwidth cap of each level of that path and its cumulative latency, so a sample
+// is charged along its path and a path cost is looked up without walking the tree.
+class Topology {
+public:
+    static constexpr double unlimited = std::numeric_limits<double>::infinity();
+
+    // devices 为 cur_expanders, 下标即设备 id; 不在树中的设备路径为空
+    void compile(CXLSwitch *root, const std::vector<CXLMemExpander *> &devices);
+
+    std::span<CXLSwitch *const> switches() const { return switches_; }
+    // 挂在树上的设备 id, 按深度优先顺序
+    std::span<const int> devices() const { return devices_; }
+    bool attached(int device) const {
+        return device >= 0 && (size_t)device < latency_.size() && first_[device] != first_[device + 1];
+    }
+    // 从直接相连的交换机到根的交换机 id
+    std::span<const uint32_t> path(int device) const {
+        return {paths_.data() + first_[device], paths_.data() + first_[device + 1]};
+    }
+    // caps[i]: 设备到 path[i] 之间所有链路的最小带宽 (GB/s)
+    std::span<const double> bandwidth_caps(int device) const {
+        return {caps_.data() + first_[device], caps_.data() + first_[device + 1]};
+    }
+    // 设备自身的平均延迟加上到根的所有链路延迟 (ns)
+    double latency(int device) const { return latency_[device]; }
+    // 到根的整条路径的带宽上限
+    double bandwidth(int device) const {
+        return first_[device] == first_[device + 1] ? unlimited : caps_[first_[device + 1] - 1];
+    }
+
+private:
+    std::vector<CXLSwitch *> switches_;
+    std::vector<int> devices_;
+    std::vector<uint32_t> first_{0}; // 设备 d 的路径为 [first_[d], first_[d + 1])
+    std::vector<uint32_t> paths_;
+    std::vector<double> caps_;
+    std::vector<double> latency_;
+};
+
+#endif // CXLMEMSIM_TOPOLOGY_H
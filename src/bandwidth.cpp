@@ -0,0 +1,59 @@
+/*
+ * CXLMemSim bandwidth
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#include "bandwidth.h"
+#include <algorithm>
+
+TokenBucket::TokenBucket(double gbps, double burst_ns)
+    : bytes_per_ns(gbps * 1024.0 * 1024.0 * 1024.0 / 1e9), burst(std::max(bytes_per_ns * burst_ns, 64.0)),
+      tokens(burst) {}
+
+double TokenBucket::consume(uint64_t timestamp, uint64_t bytes) {
+    if (bytes_per_ns <= 0.0)
+        return 0.0; // 未配置带宽, 不限速
+    // 乱序到达的样本不补充令牌
+    if (timestamp > last_timestamp) {
+        tokens = std::min(burst, tokens + bytes_per_ns * (timestamp - last_timestamp));
+        last_timestamp = timestamp;
+    }
+    tokens -= bytes;
+    return tokens < 0 ? -tokens / bytes_per_ns : 0.0;
+}
+
+bool TokenBucket::try_consume(uint64_t timestamp, uint64_t bytes) {
+    if (bytes_per_ns <= 0.0)
+        return true;
+    if (timestamp > last_timestamp) {
+        tokens = std::min(burst, tokens + bytes_per_ns * (timestamp - last_timestamp));
+        last_timestamp = timestamp;
+    }
+    if (tokens < std::min(static_cast<double>(bytes), burst))
+        return false;
+    tokens -= bytes;
+    return true;
+}
+
+double TokenBucket::delay_at(uint64_t timestamp) const {
+    if (bytes_per_ns <= 0.0 || tokens >= 0)
+        return 0.0;
+    double refilled = timestamp > last_timestamp ? bytes_per_ns * (timestamp - last_timestamp) : 0.0;
+    return std::max(0.0, -tokens - refilled) / bytes_per_ns;
+}
+
+BandwidthEngine::BandwidthEngine(double read_gbps, double write_gbps, double burst_ns)
+    : read(read_gbps, burst_ns), write(write_gbps, burst_ns) {}
+
+void BandwidthEngine::record(uint64_t timestamp, uint64_t bytes, bool is_write) {
+    pending_delay += (is_write ? write : read).consume(timestamp, bytes);
+}
+double BandwidthEngine::delay_at(uint64_t timestamp) const {
+    return std::max(read.delay_at(timestamp), write.delay_at(timestamp));
+}
@@ -33,6 +33,17 @@ BpfTimeRuntime::BpfTimeRuntime(pid_t tid, std::string program_location)
 }
 
 BpfTimeRuntime::~BpfTimeRuntime() {}
+// 在共享内存中按名字查找 map, 找不到时返回 -1
+static int find_map(std::string_view name) {
+    for (int fd = 0; fd < BPFTIME_MAX_MAP_FD; fd++) {
+        const char *map_name = nullptr;
+        if (!bpftime_is_map_fd(fd) || bpftime_map_get_info(fd, nullptr, &map_name, nullptr) < 0 || !map_name)
+            continue;
+        if (name == map_name)
+            return fd;
+    }
+    return -1;
+}
 int BpfTimeRuntime::read(CXLController *controller, BPFTimeRuntimeElem *elem) {
     mem_stats stats;
     proc_info proc_info1;
@@ -71,5 +82,24 @@ int BpfTimeRuntime::read(CXLController *controller, BPFTimeRuntimeElem *elem) {
             key1 = key; // 更新key1为当前key
         }
     }
+
+    // 释放事件: 按区间精确淘汰, 处理完后从 map 中删除; map 可能在程序加载之后才出现
+    if (frees_map_fd < 0 && (frees_map_fd = find_map("frees_map")) < 0) {
+        SPDLOG_DEBUG("frees_map not loaded yet");
+        return 0;
+    }
+    std::vector<uint64_t> freed;
+    uint64_t key = 0, key1 = 0;
+    while (bpftime_map_get_next_key(frees_map_fd, &key1, &key) == 0) {
+        auto info = (const alloc_info *)bpftime_map_lookup_elem(frees_map_fd, &key);
+        if (info != nullptr) {
+            controller->set_free(*info);
+            freed.push_back(key);
+            elem->total++;
+        }
+        key1 = key;
+    }
+    for (auto address : freed)
+        bpftime_map_delete_elem(frees_map_fd, &address);
     return 0;
 }
@@ -0,0 +1,171 @@
+/*
+ * CXLMemSim congestion
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#include "congestion.h"
+#include <algorithm>
+
+CongestionEngine::CongestionEngine(uint64_t window, uint64_t threshold) : window(window), threshold(threshold) {}
+
+uint64_t CongestionEngine::record(uint64_t timestamp, uint64_t address, bool is_write, bool track_address,
+                                  uint64_t weight) {
+    if (weight == 0)
+        return 0;
+    if (timestamp > now)
+        advance(timestamp);
+    if (timestamp + window <= now)
+        return 0; // 已经滑出窗口
+
+    uint64_t id = timestamp / threshold;
+    if (buckets.empty()) {
+        base = id;
+        buckets.emplace_back();
+    }
+    while (id < base) {
+        buckets.emplace_front();
+        base--;
+    }
+    while (id >= base + buckets.size())
+        buckets.emplace_back();
+
+    // 桶内按时间有序, 顺序到达时总是追加在末尾
+    size_t idx = id - base;
+    auto &bucket = buckets[idx];
+    auto pos = std::upper_bound(bucket.begin(), bucket.end(), timestamp,
+                                [](uint64_t ts, const sample &s) { return ts < s.timestamp; });
+    pos = bucket.insert(pos, {timestamp, address, weight, is_write, track_address});
+    samples++;
+
+    // 前驱和后继只可能在本桶或相邻桶中, 更远的样本间隔必然超过阈值
+    // Neighbours further away than the adjacent buckets are at least one threshold apart, so they never conflict
+    const sample *prev = nullptr, *next = nullptr;
+    if (pos != bucket.begin())
+        prev = &*(pos - 1);
+    else if (idx > 0 && !buckets[idx - 1].empty())
+        prev = &buckets[idx - 1].back();
+    if (pos + 1 != bucket.end())
+        next = &*(pos + 1);
+    else if (idx + 1 < buckets.size() && !buckets[idx + 1].empty())
+        next = &buckets[idx + 1].front();
+
+    // 同一时间戳上的 weight 次访问两两相邻, 自带 weight - 1 个时间冲突
+    uint64_t conflicts = weight - 1;
+    time_conflicts += weight - 1;
+    if (prev && next && close(prev->timestamp, next->timestamp))
+        time_conflicts--;
+    if (prev && close(prev->timestamp, timestamp)) {
+        time_conflicts++;
+        conflicts++;
+    }
+    if (next && close(timestamp, next->timestamp)) {
+        time_conflicts++;
+        conflicts++;
+    }
+    if (track_address)
+        conflicts += add_to_address(*pos);
+    return conflicts;
+}
+
+int CongestionEngine::pair_delta(const access &a, const access &b, int sign) {
+    if (!close(a.timestamp, b.timestamp))
+        return 0;
+    if (a.last_is_write() && b.is_write) {
+        write_write += sign; // 写-写冲突
+        return 1;
+    }
+    if (a.last_is_write() || b.is_write) {
+        read_write += sign; // 读-写或写-读冲突
+        return 1;
+    }
+    read_read += sign; // 读-读冲突不计入冲突计数
+    return 0;
+}
+
+int CongestionEngine::internal_delta(const access &a, int sign) {
+    if (a.weight < 2)
+        return 0;
+    // 首次写之后的读构成一个读-写冲突, 其余都是读-读
+    if (a.is_write) {
+        read_write += sign;
+        read_read += sign * int64_t(a.weight - 2);
+        return 1;
+    }
+    read_read += sign * int64_t(a.weight - 1);
+    return 0;
+}
+
+uint64_t CongestionEngine::add_to_address(const sample &s) {
+    auto &accesses = per_address[s.address];
+    access cur{s.timestamp, s.weight, s.is_write};
+    auto pos = std::upper_bound(accesses.begin(), accesses.end(), s.timestamp,
+                                [](uint64_t ts, const access &a) { return ts < a.timestamp; });
+    pos = accesses.insert(pos, cur);
+    const access *prev = pos != accesses.begin() ? &*(pos - 1) : nullptr;
+    const access *next = pos + 1 != accesses.end() ? &*(pos + 1) : nullptr;
+    if (prev && next)
+        pair_delta(*prev, *next, -1);
+    uint64_t conflicts = internal_delta(cur, 1);
+    if (prev)
+        conflicts += pair_delta(*prev, cur, 1);
+    if (next)
+        conflicts += pair_delta(cur, *next, 1);
+    return conflicts;
+}
+
+void CongestionEngine::advance(uint64_t now) {
+    if (now <= this->now)
+        return;
+    this->now = now;
+    // 整个桶都落在窗口之外时才淘汰
+    while (!buckets.empty() && (base + 1) * threshold + window <= now + 1)
+        expire_front();
+}
+
+void CongestionEngine::expire_front() {
+    auto &bucket = buckets.front();
+    // 按时间顺序淘汰, 每次淘汰的都是全局最老的样本, 只需撤销它与后继之间的配对
+    for (size_t i = 0; i < bucket.size(); ++i) {
+        const auto &s = bucket[i];
+        const sample *next = nullptr;
+        if (i + 1 < bucket.size())
+            next = &bucket[i + 1];
+        else if (buckets.size() > 1 && !buckets[1].empty())
+            next = &buckets[1].front();
+        if (next && close(s.timestamp, next->timestamp))
+            time_conflicts--;
+        time_conflicts -= s.weight - 1;
+
+        if (!s.track_address)
+            continue;
+        auto it = per_address.find(s.address);
+        auto &accesses = it->second;
+        if (accesses.size() > 1)
+            pair_delta(accesses[0], accesses[1], -1);
+        internal_delta(accesses[0], -1);
+        accesses.pop_front();
+        if (accesses.empty())
+            per_address.erase(it);
+    }
+    samples -= bucket.size();
+    buckets.pop_front();
+    base++;
+    // 跳过空桶, 让 base 始终指向最老的样本
+    while (!buckets.empty() && buckets.front().empty()) {
+        buckets.pop_front();
+        base++;
+    }
+}
+
+void CongestionEngine::clear() {
+    buckets.clear();
+    per_address.clear();
+    samples = 0;
+    time_conflicts = write_write = read_write = read_read = 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * CXLMemSim controller pool
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#include "controllerpool.h"
+#include <numeric>
+
+ControllerPool::ControllerPool(host_factory make_host, CXLController *fabric)
+    : make_host(std::move(make_host)), fabric_(fabric) {}
+
+CXLController *ControllerPool::host(uint64_t tgid) {
+    if (auto it = by_tgid.find(tgid); it != by_tgid.end())
+        return it->second;
+    auto *h = make_host(this);
+    hosts_.push_back(h);
+    by_tgid[tgid] = h;
+    SPDLOG_DEBUG("pool: new host {} for tgid {}", hosts_.size() - 1, tgid);
+    return h;
+}
+
+CXLController *ControllerPool::producer_host(size_t producer, uint64_t tgid) {
+    auto *h = host(tgid);
+    if (by_producer.size() <= producer)
+        by_producer.resize(producer + 1, nullptr);
+    by_producer[producer] = h;
+    // 主机为每个 producer 保留路由上下文, 须在采集线程启动前分配
+    h->set_producers(producer + 1);
+    return h;
+}
+
+CXLController *ControllerPool::host_of(size_t producer) const {
+    if (producer < by_producer.size() && by_producer[producer])
+        return by_producer[producer];
+    return hosts_.front();
+}
+
+size_t ControllerPool::drain() {
+    if (hosts_.empty())
+        return 0;
+    size_t n = 0;
+    n = drain_expanders(fabric_->cur_expanders, [&](size_t d, size_t producer, uint64_t timestamp,
+                                                    uint64_t phys_addr, bool is_write, uint64_t weight) {
+        host_of(producer)->charge_path(d, timestamp, phys_addr, is_write, weight);
+    });
+    share_delays();
+    // 主机自己的 drain 合并各采集线程的上下文, 再执行推迟的迁移/失效策略
+    for (auto *h : hosts_)
+        n += h->drain();
+    return n;
+}
+
+void ControllerPool::share_delays() {
+    // 按各主机在该链路上的流量比例分摊延迟, 本 epoch 没有流量时记给第一个主机
+    std::vector<uint64_t> traffic(hosts_.size());
+    auto split = [&](double delay) {
+        uint64_t total = std::accumulate(traffic.begin(), traffic.end(), uint64_t{0});
+        if (!total) {
+            hosts_.front()->pooled_delay += delay;
+            return;
+        }
+        for (size_t h = 0; h < hosts_.size(); h++)
+            hosts_[h]->pooled_delay += delay * traffic[h] / total;
+    };
+    const auto &expanders = fabric_->cur_expanders;
+    for (size_t d = 0; d < expanders.size(); d++) {
+        for (size_t h = 0; h < hosts_.size(); h++)
+            traffic[h] = std::exchange(hosts_[h]->device_traffic[d], 0);
+        split(expanders[d]->bandwidth_engine.drain() + expanders[d]->uplink.drain());
+    }
+    // 所有主机的拓扑都是根端口加上同一个 fabric, 共享交换机的编号相同; 根端口没有上游链路
+    auto switches = hosts_.front()->topology.switches();
+    for (size_t i = 0; i + 1 < switches.size(); i++) {
+        for (size_t h = 0; h < hosts_.size(); h++)
+            traffic[h] = std::exchange(hosts_[h]->link_traffic[i], 0);
+        split(switches[i]->uplink.drain());
+    }
+}
@@ -13,34 +13,106 @@
 #include "bpftimeruntime.h"
 #include "lbr.h"
 #include "monitor.h"
+#include "policyscheduler.h"
+#include <algorithm>
+#include <cmath>
 
 void CXLController::insert_end_point(CXLMemExpander *end_point) { this->cur_expanders.emplace_back(end_point); }
 
+// 解析分支长度, 如 "70ns/64GBps"、"120ns" 或 "1.5us"; 不带单位的数值按 ns 处理
+// Parse a branch length into {latency ns, bandwidth GB/s}. Fields are separated by '/', and a field without a
+// unit is a latency in ns, so plain Newick branch lengths keep working. Bandwidth 0 means unlimited.
+static std::pair<double, double> parse_link(const std::string &attr) {
+    double latency = 0.0, bandwidth = 0.0;
+    for (size_t begin = 0; begin <= attr.size();) {
+        size_t end = std::min(attr.find('/', begin), attr.size());
+        std::string field = attr.substr(begin, end - begin);
+        begin = end + 1;
+        if (field.empty())
+            continue;
+        size_t unit_at = 0;
+        double value;
+        try {
+            value = std::stod(field, &unit_at);
+        } catch (const std::exception &) {
+            throw std::invalid_argument("Invalid link attribute: " + attr);
+        }
+        auto unit = field.substr(unit_at);
+        if (unit.empty() || unit == "ns")
+            latency = value;
+        else if (unit == "us")
+            latency = value * 1000.0;
+        else if (unit == "GBps")
+            bandwidth = value;
+        else if (unit == "MBps")
+            bandwidth = value / 1024.0;
+        else
+            throw std::invalid_argument("Unknown unit in link attribute: " + attr);
+    }
+    return {latency, bandwidth};
+}
+
 void CXLController::construct_topo(std::string_view newick_tree) {
     auto tokens = tokenize(newick_tree);
     std::vector<CXLSwitch *> stk;
     stk.push_back(this);
+    // ':' 之后的属性作用于刚结束的节点: 叶子为 expander 的链路, ')' 为刚关闭的交换机的上游链路
+    CXLMemExpander *last_expander = nullptr;
+    CXLSwitch *last_switch = nullptr;
+    bool link_next = false;
     for (const auto &token : tokens) {
+        if (link_next) {
+            auto [latency, bandwidth] = parse_link(token);
+            if (last_expander)
+                last_expander->set_link(latency, bandwidth);
+            else if (last_switch && last_switch != this)
+                last_switch->set_link(latency, bandwidth);
+            link_next = false;
+            continue;
+        }
+        if (token == ":") {
+            link_next = true;
+            continue;
+        }
+        last_expander = nullptr;
+        last_switch = nullptr;
         if (token == "(" && num_switches == 0) {
             num_switches++;
         } else if (token == "(") {
             /** if is not on the top level */
             auto cur = new CXLSwitch(num_switches++);
+            cur->set_epoch(this->epoch);
             stk.back()->switches.push_back(cur);
             stk.push_back(cur);
         } else if (token == ")") {
             if (!stk.empty()) {
+                last_switch = stk.back();
                 stk.pop_back();
             } else {
                 throw std::invalid_argument("Unbalanced number of parentheses");
             }
         } else if (token == ",") {
         } else {
-            stk.back()->expanders.emplace_back(this->cur_expanders[atoi(token.c_str()) - 1]);
+            last_expander = this->cur_expanders[atoi(token.c_str()) - 1];
+            stk.back()->expanders.emplace_back(last_expander);
             device_map[num_end_points] = this->cur_expanders[atoi(token.c_str()) - 1];
             num_end_points++;
         }
     }
+    topology.compile(this, cur_expanders);
+}
+
+void CXLController::attach(ControllerPool *pool_, CXLController *fabric) {
+    // 主机的根端口只连着共享的 fabric, fabric 之下的交换机、expander 及其拥塞窗口由所有主机共用
+    pool = pool_;
+    cur_expanders = fabric->cur_expanders;
+    device_map = fabric->device_map;
+    num_end_points = fabric->num_end_points;
+    num_switches = fabric->num_switches + 1;
+    switches = {fabric};
+    topology.compile(this, cur_expanders);
+    device_traffic.assign(cur_expanders.size(), 0);
+    link_traffic.assign(topology.switches().size(), 0);
 }
 
 CXLController::CXLController(std::array<Policy *, 4> p, int capacity, page_type page_type_, int epoch,
@@ -48,7 +120,9 @@ CXLController::CXLController(std::array<Policy *, 4> p, int capacity, page_type
     : CXLSwitch(0), capacity(capacity), allocation_policy(dynamic_cast<AllocationPolicy *>(p[0])),
       migration_policy(dynamic_cast<MigrationPolicy *>(p[1])), paging_policy(dynamic_cast<PagingPolicy *>(p[2])),
       caching_policy(dynamic_cast<CachingPolicy *>(p[3])), page_type_(page_type_), dramlatency(dramlatency),
-      lru_cache(32 * 1024 * 1024 / 64) {
+      host_cache(32 * 1024 * 1024 / 64) {
+    // 拓扑在 construct_topo 中才建立, 先记下 epoch 供新建的交换机使用
+    this->set_epoch(epoch);
     for (auto switch_ : this->switches) {
         switch_->set_epoch(epoch);
     }
@@ -57,29 +131,74 @@ CXLController::CXLController(std::array<Policy *, 4> p, int capacity, page_type
     }
 }
 
-double CXLController::calculate_latency(const std::vector<std::tuple<uint64_t, uint64_t>> &elem, double dramlatency) {
-    return CXLSwitch::calculate_latency(elem, dramlatency);
+double CXLController::calculate_latency(uint64_t timestamp, double dramlatency) {
+    // 与 CXLMemExpander::calculate_latency 相同, 但基础延迟包含到根的链路延迟
+    double lat = 0.0;
+    for (int d : topology.devices()) {
+        if (cur_expanders[d]->count_access(timestamp))
+            lat += topology.latency(d) + dramlatency * 0.1;
+    }
+    return lat;
 }
 
-double CXLController::calculate_bandwidth(const std::vector<std::tuple<uint64_t, uint64_t>> &elem) {
-    return CXLSwitch::calculate_bandwidth(elem);
+double CXLController::calculate_bandwidth(uint64_t timestamp) {
+    // 共享链路的延迟由内存池在 drain 时分摊
+    // 迁移的拷贝和 shootdown 停顿与排队延迟一起报告
+    double bw = std::exchange(migration_delay, 0.0) / 1e6;
+    if (pool)
+        return bw + std::exchange(pooled_delay, 0.0) / 1e6;
+    for (int d : topology.devices())
+        bw += cur_expanders[d]->calculate_bandwidth(timestamp) + cur_expanders[d]->uplink.drain() / 1e6;
+    // 交换机上游端口的排队延迟, 单位与 expander 相同
+    for (auto *sw : topology.switches())
+        bw += sw->uplink.drain() / 1e6;
+    return bw;
 }
 
 void CXLController::set_stats(mem_stats stats) {
     // SPDLOG_INFO("stats: {} {} {} {} {}", stats.total_allocated, stats.total_freed, stats.current_usage,
     // stats.allocation_count, stats.free_count);
-    if (stats.total_allocated < 100000000000) {
-        for (auto switch_ : this->switches) {
-            switch_->free_stats((stats.total_freed - this->freed) / num_end_points);
-        }
-        for (auto expander_ : this->expanders) {
-            expander_->free_stats((stats.total_freed - this->freed) / num_end_points);
-        }
-    }
+    // 淘汰由 set_free 按释放的区间精确完成, 这里只记录统计
     if (stats.total_freed > this->freed)
         this->freed = stats.total_freed;
 }
 
+void CXLController::set_tracking(unsigned shift, size_t max_bytes) {
+    // 本地层与各 expander 使用相同粒度, 迁移时记录可以直接搬移
+    size_t share = max_bytes / (cur_expanders.size() + 1);
+    occupation.configure(shift, share);
+    // 共享的 expander 由内存池统一配置
+    if (pool)
+        return;
+    for (auto expander : cur_expanders)
+        expander->occupation.configure(shift, share);
+}
+
+void CXLController::set_free(const alloc_info &info) {
+    if (info.size == 0)
+        return;
+    // 逐页翻译被释放的虚拟区间, 开销与释放的字节数成正比
+    // Walk the freed virtual range page by page, so the cost scales with the freed bytes, not the table size
+    uint64_t begin = info.address, end = info.address + info.size;
+    for (uint64_t page = begin / PAGE_SIZE; page * PAGE_SIZE < end; ++page) {
+        auto it = va_pa_map.find(page);
+        if (it == va_pa_map.end())
+            continue;
+        uint64_t page_start = page * PAGE_SIZE;
+        uint64_t lo = std::max(begin, page_start), hi = std::min(end, page_start + PAGE_SIZE);
+        uint64_t phys = it->second * PAGE_SIZE;
+        occupation.erase_range(phys + (lo - page_start), phys + (hi - page_start) - 1);
+        for (int d : topology.devices())
+            cur_expanders[d]->free_range(phys + (lo - page_start), hi - lo);
+        directory.prune(phys, cur_expanders.size(), [&](int d) {
+            return store_of(d).overlaps(phys, phys + PAGE_SIZE - 1);
+        });
+        // 小对象与其他分配共享页面, 整页释放或页中已没有任何记录时才删除映射
+        if (hi - lo == PAGE_SIZE || !page_resident(phys))
+            va_pa_map.erase(it);
+    }
+}
+
 void CXLController::set_process_info(const proc_info &process_info) {
     monitors->enable(process_info.current_pid, process_info.current_tid, true, 1000, helper.num_of_cpu());
 }
@@ -89,7 +208,7 @@ void CXLController::set_thread_info(const proc_info &thread_info) {
         monitors->enable(thread_info.current_pid, thread_info.current_tid, false, 0, helper.num_of_cpu());
         // std::cout << "set thread info " << thread_info.current_pid << " " << thread_info.current_tid << std::endl;
         auto lbr_ = new lbr{.from = 0, .to = 0, .flags = 0};
-        this->insert_one(thread_map[thread_info.current_tid], *lbr_);
+        this->insert_one(thread(thread_info.current_tid), *lbr_);
         delete lbr_;
     }
 }
@@ -103,263 +222,501 @@ void CXLController::perform_migration() {
 
     // 对每个迁移项执行迁移
     for (const auto &[addr, size] : migration_list) {
-        // 查找当前地址所在的设备
-        CXLMemExpander *src_expander = nullptr;
-        int src_id = -1;
-
-        // 检查当前地址是否在控制器本地
-        bool in_controller = false;
-        for (const auto &[timestamp, info] : occupation) {
-            if (info.address == addr) {
-                in_controller = true;
-                break;
-            }
+        migrate(addr, size);
+    }
+}
+
+void CXLController::set_migration_budget(double mbps) {
+    migration_budget = mbps > 0 ? TokenBucket(mbps / 1024.0, MIGRATION_BUDGET_BURST) : TokenBucket();
+}
+
+bool CXLController::has_room(int device, size_t records) {
+    // 与分配策略的 entries_below 相同: 每条记录按页类型折算后与容量比较
+    double cap = device == PageDirectory::local ? capacity : cur_expanders[device]->capacity;
+    uint64_t per_size = page_bytes(page_type_);
+    uint64_t limit = (static_cast<uint64_t>(std::ceil(cap)) * 1024 * 1024 + per_size - 1) / per_size;
+    return store_of(device).size() + records <= limit;
+}
+
+int CXLController::migration_target(uint64_t addr, int src, size_t records) {
+    int n = cur_expanders.size();
+    if (migration_policy) {
+        int d = migration_policy->select_target_device(addr, src, this);
+        if (d != PageDirectory::none) {
+            bool valid = d == PageDirectory::local || (d >= 0 && d < n);
+            return valid && d != src && has_room(d, records) ? d : PageDirectory::none;
+        }
+    }
+    // expander 上的数据提升到本地层
+    if (src >= 0)
+        return has_room(PageDirectory::local, records) ? PageDirectory::local : PageDirectory::none;
+    // 本地层的数据降级到排队最短的 expander, 相同时选记录较少的
+    int best = PageDirectory::none;
+    double best_load = 0.0;
+    for (int d : topology.devices()) {
+        if (!has_room(d, records))
+            continue;
+        auto *expander = cur_expanders[d];
+        double load = expander->bandwidth_engine.delay_at(last_timestamp) + expander->uplink.delay_at(last_timestamp);
+        if (best == PageDirectory::none || load < best_load ||
+            (load == best_load && expander->occupation.size() < cur_expanders[best]->occupation.size())) {
+            best = d;
+            best_load = load;
         }
+    }
+    return best;
+}
 
-        // 如果不在控制器中，查找它在哪个扩展器
-        if (!in_controller) {
-            for (auto expander : this->expanders) {
-                for (const auto &info : expander->occupation) {
-                    if (info.address == addr) {
-                        src_expander = expander;
-                        break;
-                    }
-                }
-                if (src_expander)
-                    break;
-            }
+void CXLController::migrate(uint64_t addr, uint64_t size) {
+    // 查找当前地址所在的设备
+    int src_id = locate(addr);
+    if (src_id == PageDirectory::none)
+        return;
 
-            // 如果还没找到，递归搜索所有交换机
-            if (!src_expander) {
-                std::function<CXLMemExpander *(CXLSwitch *, uint64_t)> find_in_switch =
-                    [&find_in_switch](CXLSwitch *sw, uint64_t addr) -> CXLMemExpander * {
-                    if (!sw)
-                        return nullptr;
-
-                    // 检查此交换机下的扩展器
-                    for (auto expander : sw->expanders) {
-                        for (const auto &info : expander->occupation) {
-                            if (info.address == addr) {
-                                return expander;
-                            }
-                        }
-                    }
+    // 搬移 addr 所在的整个 size 字节区间内的记录
+    uint64_t bytes = std::max<uint64_t>(size, CACHELINE_SIZE);
+    uint64_t lo = addr / bytes * bytes;
+    auto &src = store_of(src_id);
+    std::vector<occupation_info> moving;
+    src.for_each_in_range(lo, lo + bytes - 1, [&](const occupation_info &info) { moving.push_back(info); });
+    if (moving.empty())
+        return;
 
-                    // 递归检查子交换机
-                    for (auto child_sw : sw->switches) {
-                        CXLMemExpander *result = find_in_switch(child_sw, addr);
-                        if (result)
-                            return result;
-                    }
+    int dst_id = migration_target(addr, src_id, moving.size());
+    if (dst_id == PageDirectory::none) {
+        migrations_no_room++;
+        return;
+    }
+    // 剩余预算不够这次拷贝时跳过, 热页会在策略下次运行时重新提出
+    if (!migration_budget.try_consume(last_timestamp, bytes)) {
+        migrations_throttled++;
+        return;
+    }
 
-                    return nullptr;
-                };
+    auto &dst = store_of(dst_id);
+    for (auto &info : moving) {
+        if (dst_id == PageDirectory::local)
+            info.timestamp = last_timestamp;
+        dst.insert(info);
+        directory.add(info.address, dst_id);
+        src.erase(info.address);
+    }
 
-                src_expander = find_in_switch(this, addr);
-            }
-        }
+    // 更新统计信息
+    if (src_id >= 0)
+        cur_expanders[src_id]->counter.migrate_out.increment();
+    if (dst_id >= 0)
+        cur_expanders[dst_id]->counter.migrate_in.increment();
+    migrated_bytes += bytes;
+
+    // 拷贝读源端写目的端, 停顿为首次访问的路径延迟加上按较慢一端带宽的传输时间, 再加一次 TLB shootdown
+    double copy = 0.0, rate = Topology::unlimited;
+    if (src_id >= 0) {
+        charge_copy(src_id, last_timestamp, bytes, false);
+        copy += topology.latency(src_id);
+        rate = std::min({rate, cur_expanders[src_id]->bandwidth.read, topology.bandwidth(src_id)});
+    }
+    if (dst_id >= 0) {
+        charge_copy(dst_id, last_timestamp, bytes, true);
+        copy += topology.latency(dst_id);
+        rate = std::min({rate, cur_expanders[dst_id]->bandwidth.write, topology.bandwidth(dst_id)});
+    }
+    if (rate > 0 && rate != Topology::unlimited)
+        copy += bytes / rate;
+    migration_delay += copy + shootdown_latency;
+}
 
-        // 选择目标设备（这里简单地选择控制器）
-        // 在实际应用中，你可能需要更复杂的目标选择逻辑
-        if (in_controller) {
-            // 如果数据已在控制器中，选择一个负载较轻的扩展器
-            // 这里简单地选择第一个扩展器
-            if (!expanders.empty()) {
-                CXLMemExpander *dst_expander = expanders[0];
-
-                // 从控制器迁移到扩展器
-                for (auto it = occupation.begin(); it != occupation.end(); ++it) {
-                    if (it->second.address == addr) {
-                        // 复制数据到目标扩展器
-                        occupation_info new_info = it->second;
-
-                        // 添加到目标扩展器
-                        dst_expander->occupation.push_back(new_info);
-
-                        // 更新统计信息
-                        dst_expander->counter.migrate_in.increment();
-
-                        // 可选：从控制器中移除
-                        occupation.erase(it);
-                        break;
-                    }
-                }
-            }
-        } else if (src_expander) {
-            // 从扩展器迁移到控制器
-            // 查找地址在扩展器中的数据
-            for (size_t i = 0; i < src_expander->occupation.size(); i++) {
-                auto &info = src_expander->occupation[i];
-                if (info.address == addr) {
-                    // 复制数据到控制器
-                    uint64_t current_timestamp = last_timestamp;
-                    occupation.emplace(current_timestamp, info);
-
-                    // 更新统计信息
-                    src_expander->counter.migrate_out.increment();
-
-                    // 可选：从源扩展器中移除
-                    src_expander->occupation.erase(src_expander->occupation.begin() + i);
-                    break;
-                }
-            }
-        }
+bool CXLController::page_resident(uint64_t phys) {
+    uint64_t lo = phys & ~(directory.page_size() - 1), hi = lo + directory.page_size() - 1;
+    return directory.find(lo, cur_expanders.size(), [&](int d) { return store_of(d).overlaps(lo, hi); }) !=
+           PageDirectory::none;
+}
+
+int CXLController::locate(uint64_t addr) {
+    int n = cur_expanders.size();
+    int device = directory.find(addr, n, [&](int d) { return store_of(d).contains(addr); });
+    if (device == PageDirectory::none) {
+        // 目录里只剩过期的位, 顺便清理掉
+        uint64_t lo = addr & ~(directory.page_size() - 1), hi = lo + directory.page_size() - 1;
+        directory.prune(addr, n, [&](int d) { return store_of(d).overlaps(lo, hi); });
     }
+    return device;
+}
+
+void CXLController::delete_entry(uint64_t addr, uint64_t length) {
+    for (int d : topology.devices())
+        cur_expanders[d]->delete_entry(addr, length);
 }
 
-void CXLController::delete_entry(uint64_t addr, uint64_t length) { CXLSwitch::delete_entry(addr, length); }
+uint32_t CXLController::thread_id(uint64_t tid) {
+    auto [it, created] = thread_index.try_emplace(tid, threads.size());
+    if (created)
+        threads.emplace_back();
+    return it->second;
+}
 
 void CXLController::insert_one(thread_info &t_info, lbr &lbr) {
     auto &rob = t_info.rob;
     auto llcm_count = (lbr.flags & LBR_DATA_MASK) >> LBR_DATA_SHIFT;
     auto ins_count = (lbr.flags & LBR_INS_MASK) >> LBR_INS_SHIFT;
 
-    // ——在这里插入 ring_buffer，表示我们接收到了一个新的 lbr
-    ring_buffer.push(lbr);
+    // 记录进本线程的 LBR 窗口
+    auto &window = t_info.lbr_window;
+    window.push_back({static_cast<uint32_t>(ins_count), static_cast<uint32_t>(llcm_count)});
 
-    for (int i = 0; i < llcm_count; i++) {
+    for (int64_t need = llcm_count; need > 0;) {
         if (t_info.llcm_type.empty()) {
-            // 如果 llcm_type 为空，直接插入 0
-            t_info.llcm_type.push(0);
+            // 如果 llcm_type 为空，剩下的都按本地访问处理
+            t_info.llcm_type.push_back({LLCM_LOCAL, need});
         }
-        rob.m_count[t_info.llcm_type.front()]++;
-        t_info.llcm_type_rob.push(t_info.llcm_type.front());
-        t_info.llcm_type.pop();
+        auto &run = t_info.llcm_type.front();
+        int64_t k = std::min(run.count, need);
+        rob.m_count[run.type] += k;
+        thread_info::push(t_info.llcm_type_rob, run.type, k);
+        need -= k;
+        if ((run.count -= k) == 0)
+            t_info.llcm_type.pop_front();
     }
     rob.llcm_count += llcm_count;
     rob.ins_count += ins_count;
 
-    while (rob.ins_count > ROB_SIZE) {
-        auto old_lbr = ring_buffer.front();
-        llcm_count = (old_lbr.flags & LBR_DATA_MASK) >> LBR_DATA_SHIFT;
-        ins_count = (old_lbr.flags & LBR_INS_MASK) >> LBR_INS_SHIFT;
+    // 退休本线程最老的记录直到窗口不超过 ROB_SIZE 条指令; 窗口满时 (大量不含指令的记录) 同样退休最老的一条
+    while (!window.empty() && (rob.ins_count > ROB_SIZE || window.full())) {
+        auto old = window.front();
+        window.pop_front();
+        llcm_count = old.llcm_count;
 
-        rob.ins_count -= ins_count;
+        rob.ins_count -= old.ins_count;
         rob.llcm_count -= llcm_count;
         rob.llcm_base += llcm_count;
 
-        for (int i = 0; i < llcm_count; i++) {
-            rob.m_count[t_info.llcm_type_rob.front()]--;
-            t_info.llcm_type_rob.pop();
+        for (int64_t need = llcm_count; need > 0 && !t_info.llcm_type_rob.empty();) {
+            auto &run = t_info.llcm_type_rob.front();
+            int64_t k = std::min(run.count, need);
+            rob.m_count[run.type] -= k;
+            need -= k;
+            if ((run.count -= k) == 0)
+                t_info.llcm_type_rob.pop_front();
         }
-        ring_buffer.pop();
     }
 }
 int CXLController::insert(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr, int index) {
-    auto &t_info = thread_map[tid];
-
-    // 计算时间步长
-    uint64_t time_step = 0;
-    if (index > last_index) {
-        time_step = (timestamp - last_timestamp) / (index - last_index);
+    mem_sample sample{timestamp, tid, phys_addr, virt_addr, index};
+    return insert({&sample, 1});
+}
+int CXLController::insert(std::span<const mem_sample> samples) {
+    int res = insert_batch(samples, serial, -1);
+    if (merge(serial))
+        poll_policies();
+    return res;
+}
+int CXLController::insert_concurrent(int producer, std::span<const mem_sample> samples) {
+    if (producer >= 0 && producer < (int)contexts.size())
+        return insert_batch(samples, contexts[producer], producer);
+    // 未注册的 producer 共用一个上下文, 同样推迟到 drain 合并
+    std::lock_guard lock(ingest_mutex_);
+    return insert_batch(samples, unregistered, producer);
+}
+void CXLController::set_producers(size_t n) {
+    if (contexts.size() < n)
+        contexts.resize(n);
+    // 共享的 expander 由 fabric 配置
+    if (pool)
+        return;
+    for (auto expander : cur_expanders)
+        expander->set_producers(n);
+}
+size_t CXLController::drain() {
+    // 每个 expander 的样本沿编译好的路径向上计入各级交换机; 内存池中由 pool 按 producer 分派给各主机
+    size_t n = 0;
+    if (!pool) {
+        n = drain_expanders(cur_expanders, [&](size_t d, size_t, uint64_t timestamp, uint64_t phys_addr,
+                                               bool is_write, uint64_t weight) {
+            charge_path(d, timestamp, phys_addr, is_write, weight);
+        });
+    }
+    bool ingested = false;
+    for (auto &ctx : contexts)
+        ingested |= merge(ctx);
+    ingested |= merge(unregistered);
+    // 迁移和回写失效会修改 occupation, 必须等所有样本落地后再执行
+    if (ingested)
+        poll_policies();
+    return n;
+}
+bool CXLController::merge(ingest_context &ctx) {
+    if (ctx.empty())
+        return false;
+    // 在加入新映射之前清理, 之前合并的页都已记录到各层
+    if (va_pa_map.size() > va_pa_limit) {
+        std::erase_if(va_pa_map, [&](const auto &entry) { return !page_resident(entry.second * PAGE_SIZE); });
+        // 阈值随剩余大小翻倍, 清理的开销均摊为 O(1)
+        va_pa_limit = std::max<size_t>(VA_PA_MIN_ENTRIES, va_pa_map.size() * 2);
+    }
+    for (const auto &[virt_page, phys_page] : ctx.va_pa)
+        va_pa_map[virt_page] = phys_page;
+    for (const auto &p : ctx.placements) {
+        if (p.device == PageDirectory::local)
+            access_local(p.timestamp, p.phys_addr);
+        else if (p.phys_addr)
+            directory.add(p.phys_addr, p.device);
+    }
+    for (const auto &u : ctx.llcm)
+        thread_info::push(thread(u.tid).llcm_type, u.type, u.count);
+    if (migration_policy) {
+        for (const auto &h : ctx.observed)
+            migration_policy->observe_access(h.addr, h.timestamp, h.weight);
+    }
+    request_counter += std::exchange(ctx.requests, 0);
+    last_timestamp = std::max(last_timestamp, ctx.last_timestamp);
+    ctx.placements.clear();
+    ctx.va_pa.clear();
+    ctx.llcm.clear();
+    ctx.observed.clear();
+    return true;
+}
+void CXLController::poll_policies() {
+    // 策略在后台线程上运行时, 这里只应用已完成的计划并按各策略的节奏提交快照
+    if (scheduler)
+        scheduler->poll(std::exchange(request_counter, 0), last_timestamp);
+    else if (policies_due())
+        run_policies();
+}
+void CXLController::start_scheduler() {
+    if (!scheduler)
+        scheduler = new PolicyScheduler(this, cadence);
+}
+void CXLController::stop_scheduler() {
+    if (!scheduler)
+        return;
+    scheduler->flush();
+    delete std::exchange(scheduler, nullptr);
+}
+bool CXLController::policies_due() const {
+    return (cadence.samples && request_counter >= cadence.samples) ||
+           (cadence.interval && last_timestamp - last_policy_run >= cadence.interval);
+}
+void CXLController::run_policies() {
+    request_counter = 0;
+    last_policy_run = last_timestamp;
+    if (migration_policy && migration_policy->compute_once(this) > 0) {
+        perform_migration();
+    }
+    if (caching_policy && caching_policy->compute_once(this) > 0) {
+        perform_back_invalidation();
+    }
+}
+int CXLController::insert_batch(std::span<const mem_sample> samples, ingest_context &ctx, int producer) {
+    // 每条 PEBS 记录代表 index - last_index 次访问, 作为一个带权样本处理; 按到达顺序先算出时间范围
+    struct pending {
+        uint32_t sample;
+        uint32_t count;
+        uint64_t start;
+        uint64_t step;
+    };
+    std::vector<pending> work;
+    work.reserve(samples.size());
+    for (uint32_t i = 0; i < samples.size(); i++) {
+        const auto &s = samples[i];
+        if (s.phys_addr && s.virt_addr)
+            ctx.va_pa.emplace_back(s.virt_addr / PAGE_SIZE, s.phys_addr / PAGE_SIZE);
+        uint32_t count = s.index > ctx.last_index ? s.index - ctx.last_index : 0;
+        // 时间戳回退时 (乱序的记录) 全部落在该时刻上
+        uint64_t step = count && s.timestamp > ctx.last_timestamp ? (s.timestamp - ctx.last_timestamp) / count : 0;
+        if (count)
+            work.push_back({i, count, step ? ctx.last_timestamp : s.timestamp, step});
+        ctx.requests += count;
+        // 更新最后的索引和时间戳
+        ctx.last_index = s.index > 0 ? s.index : ctx.last_index;
+        ctx.last_timestamp = std::max(ctx.last_timestamp, s.timestamp);
     }
-    uint64_t current_timestamp = last_timestamp;
-
-    bool res = true;
-    for (int i = last_index; i < index; i++) {
-        // 更新当前时间戳
-        current_timestamp += time_step;
-
-        // 首先检查LRU缓存
-        auto cache_result = access_cache(phys_addr, current_timestamp);
-
-        if (cache_result.has_value()) {
-            // 缓存命中
-            this->counter.inc_hitm();
-            t_info.llcm_type.push(0); // 本地访问类型
-            continue;
-        }
 
-        // 缓存未命中，决定分配策略
-        auto numa_policy = allocation_policy->compute_once(this);
+    // 按 (线程, 页) 分组, 组内保持到达顺序; 策略每组只调用一次
+    std::stable_sort(work.begin(), work.end(), [&](const pending &a, const pending &b) {
+        const auto &x = samples[a.sample], &y = samples[b.sample];
+        return std::pair(x.tid, x.phys_addr / PAGE_SIZE) < std::pair(y.tid, y.phys_addr / PAGE_SIZE);
+    });
 
-        // 检查是否需要页表遍历，并获取额外延迟
+    bool res = true;
+    for (size_t g = 0; g < work.size();) {
+        const auto &first = samples[work[g].sample];
+        size_t end = g + 1;
+        while (end < work.size() && samples[work[end].sample].tid == first.tid &&
+               samples[work[end].sample].phys_addr / PAGE_SIZE == first.phys_addr / PAGE_SIZE)
+            end++;
+
+        // 第一次未命中时决定分配和页表遍历, 之后同页的访问命中 TLB
+        bool decided = false;
+        int numa_policy = -1;
         uint64_t ptw_latency = 0;
-        if (paging_policy) {
-            // 判断是远程访问还是本地访问
-            bool is_remote = numa_policy != -1;
-            ptw_latency = paging_policy->check_page_table_walk(virt_addr, phys_addr, is_remote, page_type_);
-
-            // 如果需要页表遍历，增加延迟
-            if (ptw_latency > 0) {
-                // 这里可以根据需要处理额外延迟
-                latency_lat += ptw_latency;
-                // 或者在计算总延迟时考虑这个因素
+        int cacheable = -1;
+        // 整组作为一次带权访问报告给迁移策略
+        uint64_t group_weight = 0, group_timestamp = 0;
+        // 主机缓存在整组内持有, 只在调用策略时让出
+        std::unique_lock cache_lock(cache_mutex_);
+        for (; g < end; g++) {
+            const auto &s = samples[work[g].sample];
+            // weight 次访问落在 (start, start + weight * step] 上, 都访问同一地址; step 为 0 时都在 start
+            uint64_t weight = work[g].count;
+            uint64_t first_timestamp = work[g].start + work[g].step;
+            uint64_t group_last = work[g].start + weight * work[g].step;
+            group_weight += weight;
+            group_timestamp = std::max(group_timestamp, group_last);
+
+            // 首先检查主机缓存
+            if (access_cache(s.phys_addr, first_timestamp).has_value()) {
+                // 缓存命中
+                this->counter.inc_hitm(weight);
+                ctx.push_llcm(s.tid, LLCM_LOCAL, weight); // 本地访问类型
+                continue;
             }
-        }
-
-        if (numa_policy == -1) {
-            // 本地访问
-            this->occupation.emplace(current_timestamp, occupation_info{phys_addr, 1, current_timestamp + ptw_latency});
-            this->counter.inc_local();
-            t_info.llcm_type.push(0);
 
-            // 更新缓存
-            update_cache(phys_addr, phys_addr, current_timestamp);
-        } else {
-            // 远程访问
-            this->counter.inc_remote();
-            for (auto switch_ : this->switches) {
-                res &= switch_->insert(current_timestamp + ptw_latency, tid, phys_addr, virt_addr, numa_policy);
+            uint64_t walk = 0;
+            if (!decided) {
+                cache_lock.unlock();
+                {
+                    std::lock_guard lock(policy_mutex_);
+                    // 缓存未命中，决定分配策略
+                    numa_policy = allocation_policy->place(this, first_timestamp, s.phys_addr);
+                    // 检查是否需要页表遍历，并获取额外延迟
+                    if (paging_policy) {
+                        ptw_latency = paging_policy->check_page_table_walk(s.virt_addr, s.phys_addr,
+                                                                           numa_policy != -1, page_type_);
+                        latency_lat += ptw_latency;
+                    }
+                    // 如果缓存策略允许缓存远程访问的数据
+                    if (numa_policy != -1)
+                        cacheable = caching_policy->should_cache(s.phys_addr, first_timestamp);
+                }
+                cache_lock.lock();
+                walk = ptw_latency;
+                decided = true;
             }
-            for (auto expander_ : this->expanders) {
-                res &= expander_->insert(current_timestamp + ptw_latency, tid, phys_addr, virt_addr, numa_policy);
+
+            if (numa_policy == -1) {
+                // 本地访问, 之后的 weight - 1 次命中刚填入的缓存
+                ctx.placements.push_back({first_timestamp + walk, s.phys_addr, PageDirectory::local});
+                ctx.push_llcm(s.tid, LLCM_LOCAL, weight);
+                this->counter.inc_hitm(weight - 1);
+
+                // 更新缓存
+                update_cache(s.phys_addr, s.phys_addr, first_timestamp);
+                continue;
             }
-            t_info.llcm_type.push(1); // 远程访问类型
 
-            // 如果缓存策略允许缓存远程访问的数据
-            if (caching_policy->should_cache(phys_addr, current_timestamp)) {
-                update_cache(phys_addr, phys_addr, current_timestamp);
+            // 远程访问
+            ctx.placements.push_back({first_timestamp + walk, s.phys_addr, numa_policy});
+            if (cacheable) {
+                res &= access_remote(first_timestamp + walk, s.tid, s.phys_addr, s.virt_addr, numa_policy, producer,
+                                     1);
+                ctx.push_llcm(s.tid, LLCM_REMOTE, 1); // 远程访问类型
+                ctx.push_llcm(s.tid, LLCM_LOCAL, weight - 1);
+                this->counter.inc_hitm(weight - 1);
+                update_cache(s.phys_addr, s.phys_addr, first_timestamp);
+            } else {
+                // 不缓存时全部 weight 次访问都到达设备, 以最后一次的时间戳记录
+                res &= access_remote(std::max(first_timestamp + walk, group_last), s.tid, s.phys_addr,
+                                     s.virt_addr, numa_policy, producer, weight);
+                ctx.push_llcm(s.tid, LLCM_REMOTE, weight); // 远程访问类型
             }
         }
+        cache_lock.unlock();
+        if (migration_policy && first.phys_addr)
+            ctx.observed.push_back({first.phys_addr, group_timestamp, group_weight});
     }
-    static int request_counter = 0;
-    request_counter += (index - last_index);
-    if (request_counter >= 1000) {
-        if (migration_policy && migration_policy->compute_once(this) > 0) {
-            perform_migration();
+    return res;
+}
+void CXLController::access_local(uint64_t timestamp, uint64_t phys_addr) {
+    this->occupation.record(phys_addr, timestamp, !this->occupation.contains(phys_addr));
+    if (phys_addr)
+        directory.add(phys_addr, PageDirectory::local);
+    this->counter.inc_local();
+}
+int CXLController::access_remote(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr,
+                                 int device, int producer, uint64_t weight) {
+    this->counter.inc_remote(weight);
+    if (producer >= 0 && device < (int)cur_expanders.size()) {
+        // 只入队, 拥塞和计数在 drain 时按拓扑补记
+        cur_expanders[device]->enqueue(producer, timestamp, phys_addr, weight);
+        return 1;
+    }
+    if (device < 0 || device >= (int)cur_expanders.size())
+        return 0;
+    // 直接插入目标设备, 再沿路径计入各级交换机, 不再逐层尝试
+    int ret = cur_expanders[device]->insert(timestamp, tid, phys_addr, virt_addr, device, weight);
+    if (ret)
+        charge_path(device, timestamp, phys_addr, ret == 1, weight);
+    return ret;
+}
+void CXLController::charge_path(int device, uint64_t timestamp, uint64_t phys_addr, bool is_write, uint64_t weight) {
+    auto switches = topology.switches();
+    auto path = topology.path(device);
+    // 访问经过 expander 和路径上每个非根交换机的上游链路, 只有限速的链路需要记账
+    if (cur_expanders[device]->link_bandwidth > 0)
+        record_weighted(cur_expanders[device]->uplink, timestamp, is_write, weight);
+    if (pool)
+        device_traffic[device] += weight;
+    for (size_t level = 0; level < path.size(); level++) {
+        auto *sw = switches[path[level]];
+        count_weighted(sw->counter, is_write, weight);
+        // 直接相连的交换机统计地址冲突, 上层交换机只参与时间冲突
+        if (phys_addr)
+            sw->record_congestion(timestamp, phys_addr, is_write, level == 0, weight);
+        if (level + 1 < path.size() && sw->link_bandwidth > 0) {
+            record_weighted(sw->uplink, timestamp, is_write, weight);
+            if (pool)
+                link_traffic[path[level]] += weight;
         }
-        if (caching_policy && caching_policy->compute_once(this) > 0) {
-            perform_back_invalidation();
+    }
+}
+void CXLController::charge_copy(int device, uint64_t timestamp, uint64_t bytes, bool is_write) {
+    auto *expander = cur_expanders[device];
+    expander->bandwidth_engine.record(timestamp, bytes, is_write);
+    if (expander->link_bandwidth > 0)
+        expander->uplink.record(timestamp, bytes, is_write);
+    // 内存池按缓存行数分摊共享链路的延迟
+    uint64_t lines = bytes / CACHELINE_SIZE;
+    if (pool)
+        device_traffic[device] += lines;
+    auto switches = topology.switches();
+    auto path = topology.path(device);
+    for (size_t level = 0; level + 1 < path.size(); level++) {
+        auto *sw = switches[path[level]];
+        if (sw->link_bandwidth > 0) {
+            sw->uplink.record(timestamp, bytes, is_write);
+            if (pool)
+                link_traffic[path[level]] += lines;
         }
-        request_counter = 0;
     }
-    // 更新最后的索引和时间戳
-    last_index = index > 0 ? index : last_index;
-    last_timestamp = timestamp;
-    return res;
 }
 int CXLController::insert(uint64_t timestamp, uint64_t tid, lbr lbrs[32], cntr counters[32]) {
+    auto &t_info = thread(tid);
     // 处理LBR记录
     for (int i = 0; i < 32; i++) {
         if (!lbrs[i].from) {
             break;
         }
-        insert_one(thread_map[tid], lbrs[i]);
+        insert_one(t_info, lbrs[i]);
     }
 
-    auto all_access = get_access(timestamp);
-    auto &t_info = thread_map[tid];
-
-    // 对每个endpoint计算延迟并累加
-    double total_latency = 0.0;
-    std::function<void(CXLSwitch *)> dfs_calculate = [&](CXLSwitch *node) {
-        // 处理当前节点的expanders
-        for (auto *expander : node->expanders) {
-            total_latency += get_endpoint_rob_latency(expander, all_access, t_info, dramlatency);
-        }
 
-        // 递归处理子节点
-        for (auto *switch_ : node->switches) {
-            dfs_calculate(switch_);
-        }
-    };
+    // 用向量化的计数内核统计每个 endpoint 在时间窗口内的访问数
+    std::vector<size_t> device_access(cur_expanders.size(), 0);
+    size_t total_access = 0;
+    for (int d : topology.devices()) {
+        device_access[d] = cur_expanders[d]->count_access(timestamp);
+        total_access += device_access[d];
+    }
 
-    // 从当前controller开始DFS遍历
-    dfs_calculate(this);
+    // 对每个endpoint计算延迟并累加, 基础延迟直接查编译好的路径代价
+    double total_latency = 0.0;
+    for (int d : topology.devices()) {
+        total_latency +=
+            get_endpoint_rob_latency(topology.latency(d), total_access - device_access[d], t_info, dramlatency);
+    }
 
-    latency_lat += std::max(total_latency + std::get<0>(calculate_congestion()), 0.0);
-    bandwidth_lat += std::max(calculate_bandwidth(all_access), 0.0);
+    latency_lat += std::max(total_latency + calculate_congestion(timestamp), 0.0);
+    bandwidth_lat += std::max(calculate_bandwidth(timestamp), 0.0);
 
     return 0;
 }
@@ -382,10 +739,18 @@ std::vector<std::string> CXLController::tokenize(const std::string_view &s) {
     return res;
 }
 std::vector<std::tuple<uint64_t, uint64_t>> CXLController::get_access(uint64_t timestamp) {
-    return CXLSwitch::get_access(timestamp);
+    std::vector<std::tuple<uint64_t, uint64_t>> result;
+    for (int d : topology.devices()) {
+        cur_expanders[d]->for_each_access(
+            timestamp, [&](uint64_t ts, uint64_t addr, CXLMemExpander *) { result.emplace_back(ts, addr); });
+    }
+    return result;
 }
-std::tuple<double, std::vector<uint64_t>> CXLController::calculate_congestion() {
-    return CXLSwitch::calculate_congestion();
+double CXLController::calculate_congestion(uint64_t timestamp) {
+    double latency = 0.0;
+    for (auto *sw : topology.switches())
+        latency += sw->local_congestion(timestamp);
+    return latency;
 }
 void CXLController::set_epoch(int epoch) { CXLSwitch::set_epoch(epoch); }
 // 在CXLController类中添加
@@ -397,36 +762,31 @@ void CXLController::perform_back_invalidation() {
 
     // 对每个地址执行失效
     for (const auto &addr : invalidation_list) {
-        // 从本地缓存中移除
-        if (lru_cache.remove(addr)) {
-            counter.inc_backinv();
-        }
-        // 从所有内存扩展器的occupation中移除
-        invalidate_in_expanders(addr);
+        back_invalidate(addr);
     }
 }
 
+void CXLController::back_invalidate(uint64_t addr) {
+    // 从本地缓存中移除
+    if (host_cache.remove(addr)) {
+        counter.inc_backinv();
+    }
+    // 从所有内存扩展器的occupation中移除
+    invalidate_in_expanders(addr);
+}
+
 // 递归地处理所有扩展器中的失效
 void CXLController::invalidate_in_expanders(uint64_t addr) {
-    // 处理当前控制器直接连接的扩展器
-    for (auto expander : expanders) {
-        if (expander) {
-            // 从expander的occupation中移除指定地址
-            for (auto it = expander->occupation.begin(); it != expander->occupation.end();) {
-                if (it->address == addr) {
-                    it = expander->occupation.erase(it);
-                    counter.inc_backinv();
-                } else {
-                    ++it;
-                }
-            }
+    // 只访问目录中持有该页的 expander, 不再遍历整棵拓扑
+    directory.find(addr, cur_expanders.size(), [&](int d) {
+        // 从expander的occupation中移除指定地址
+        if (d >= 0 && cur_expanders[d]->occupation.erase(addr)) {
+            counter.inc_backinv();
         }
-    }
-
-    // 递归处理所有连接的交换机
-    for (auto switch_ : switches) {
-        invalidate_in_switch(switch_, addr);
-    }
+        return false;
+    });
+    uint64_t lo = addr & ~(directory.page_size() - 1), hi = lo + directory.page_size() - 1;
+    directory.prune(addr, cur_expanders.size(), [&](int d) { return store_of(d).overlaps(lo, hi); });
 }
 
 // 在交换机及其子节点中执行失效
@@ -438,13 +798,8 @@ void CXLController::invalidate_in_switch(CXLSwitch *switch_, uint64_t addr) {
     for (auto expander : switch_->expanders) {
         if (expander) {
             // 从expander的occupation中移除指定地址
-            for (auto it = expander->occupation.begin(); it != expander->occupation.end();) {
-                if (it->address == addr) {
-                    it = expander->occupation.erase(it);
-                    counter.inc_backinv();
-                } else {
-                    ++it;
-                }
+            if (expander->occupation.erase(addr)) {
+                counter.inc_backinv();
             }
         }
     }
@@ -10,7 +10,7 @@
  */
 
 #include "cxlendpoint.h"
-#include <random>
+#include <thread>
 
 CXLMemExpander::CXLMemExpander(int read_bw, int write_bw, int read_lat, int write_lat, int id, int capacity)
     : capacity(capacity), id(id) {
@@ -18,173 +18,142 @@ CXLMemExpander::CXLMemExpander(int read_bw, int write_bw, int read_lat, int writ
     this->bandwidth.write = write_bw;
     this->latency.read = read_lat;
     this->latency.write = write_lat;
+    this->bandwidth_engine = BandwidthEngine(this->bandwidth.read, this->bandwidth.write);
 }
-// 修改CXLMemExpander的calculate_latency函数
-double CXLMemExpander::calculate_latency(const std::vector<std::tuple<uint64_t, uint64_t>> &elem, double dramlatency) {
-    if (elem.empty()) {
+// 每次访问的延迟相同, 平均值只取决于窗口内是否有访问
+double CXLMemExpander::calculate_latency(uint64_t timestamp, double dramlatency) {
+    if (count_access(timestamp) == 0)
         return 0.0;
-    }
-
-    // 首先更新地址缓存以确保其最新
-    update_address_cache();
-
-    double total_latency = 0.0;
-    size_t access_count = 0;
-
-    for (const auto &[timestamp, addr] : elem) {
-        // 使用哈希表检查是否是本endpoint的访问
-        bool is_local_access = is_address_local(addr);
-
-        if (!is_local_access)
-            continue;
-
-        // 基础延迟计算
-        double current_latency = (this->latency.read + this->latency.write) / 2.0;
-
-        // 考虑DRAM延迟影响
-        current_latency += dramlatency * 0.1;
-
-        total_latency += current_latency;
-        access_count++;
-    }
-
-    return access_count > 0 ? total_latency / access_count : 0.0;
+    // 基础延迟计算, 并考虑DRAM延迟影响
+    return (this->latency.read + this->latency.write) / 2.0 + dramlatency * 0.1;
 }
-
-double CXLMemExpander::calculate_bandwidth(const std::vector<std::tuple<uint64_t, uint64_t>> &elem) {
-    if (elem.empty()) {
-        return 0.0;
-    }
-
-    // 获取20ms时间窗口内的访问
-    uint64_t current_time = std::get<0>(elem.back());
-    uint64_t window_start = current_time - 20000000; // 20ms = 20,000,000ns
-
-    // 计算时间窗口内的访问次数
-    size_t access_count = 0;
-    uint64_t total_data = 0;
-    constexpr uint64_t CACHE_LINE_SIZE = 64; // 假设缓存行大小为64字节
-
-    for (const auto &[timestamp, addr] : elem) {
-        if (timestamp >= window_start) {
-            access_count++;
-            total_data += CACHE_LINE_SIZE; // TODO other than cacheline granularity
-        }
-    }
-
-    // 计算带宽 (GB/s)
-    // 带宽 = (总数据量 / 时间窗口)
-    double time_window_seconds = 0.02; // 20ms = 0.02s
-    double bandwidth_gbps = (total_data / time_window_seconds) / (1024.0 * 1024.0 * 1024.0);
-
-    // 确保带宽不超过设备限制
-    double max_bandwidth = this->bandwidth.read + this->bandwidth.write;
-    return std::min(bandwidth_gbps- max_bandwidth, 0.0);
+void CXLMemExpander::set_link(double latency, double bandwidth) {
+    link_latency = latency;
+    link_bandwidth = bandwidth;
+    // 链路全双工, 两个方向各有完整带宽
+    uplink = BandwidthEngine(bandwidth, bandwidth);
+}
+double CXLMemExpander::calculate_bandwidth(uint64_t timestamp) {
+    // 令牌桶在每次插入时已经更新, 这里只取出累计的排队延迟
+    // Queueing delay is accumulated by the token buckets on insert; report it in the same unit as latency_lat
+    // (the monitor loop scales by 1e6 to get nanoseconds)
+    return bandwidth_engine.drain() / 1e6;
 }
 void CXLMemExpander::delete_entry(uint64_t addr, uint64_t length) {
-    bool modified = false;
-
-    // 使用引用来确保可以修改 occupation 中的元素
-    for (auto& occ : occupation) {
-        if (occ.address == addr) {
-            occ.access_count++;
-            occ.timestamp = last_timestamp;
-            modified = true;
-        }
-    }
-
+    // 区间与本设备不相交时直接跳过
+    if (!occupation.overlaps(addr, addr + length))
+        return;
     // kernel mode access
-    this->counter.inc_load();  // 只调用一次而不是每次迭代
-    for (auto& occ : occupation) {
-        if (occ.address >= addr && occ.address <= addr + length) {
-            if (occ.address == addr) {
-                continue;  // 已经在上面处理过
-            }
-            occ.access_count++;
-            occ.timestamp = last_timestamp;
-            modified = true;
-        }
-    }
+    this->counter.inc_load();
 
-    // 如果有修改，标记缓存为无效
-    if (modified) {
-        invalidate_cache();
-    }
+    // 先收集命中的条目, touch 会把条目移动到队尾
+    std::vector<occupation_info> hit;
+    occupation.for_each_in_range(addr, addr + length, [&](const occupation_info &occ) { hit.push_back(occ); });
+    for (const auto &occ : hit)
+        occupation.touch(occ.address, last_timestamp, occ.access_count + 1);
 }
 
-int CXLMemExpander::insert(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr, int index) {
+int CXLMemExpander::insert(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr, int index,
+                           uint64_t weight) {
     if (index == this->id) {
-        last_timestamp = last_timestamp > timestamp ? last_timestamp : timestamp;
-
-        if (phys_addr != 0) {
-            // 使用哈希表快速检查地址是否已存在
-            bool address_exists = address_cache.find(phys_addr) != address_cache.end();
-
-            if (address_exists) {
-                // 地址已存在，找到并更新
-                for (auto it = this->occupation.cbegin(); it != this->occupation.cend(); it++) {
-                    if (it->address == phys_addr) {
-                        this->occupation.erase(it);
-                        this->occupation.emplace_back(timestamp, phys_addr, 0);
-                        this->counter.inc_load();
-
-                        // 不需要更新缓存，地址没变
-                        return 2;
-                    }
-                }
-            }
-
-            // 地址不存在，添加新条目
-            this->occupation.emplace_back(timestamp, phys_addr, 0);
-
-            // 更新地址缓存
-            address_cache.insert(phys_addr);
-
-            this->counter.inc_store();
-            return 1;
+        std::unique_lock lock(occupationMutex_);
+        return apply(timestamp, phys_addr, weight);
+    }
+    return 0;
+}
+int CXLMemExpander::apply(uint64_t timestamp, uint64_t phys_addr, uint64_t weight) {
+    last_timestamp = last_timestamp > timestamp ? last_timestamp : timestamp;
+
+    if (phys_addr != 0) {
+        // 地址已存在时 O(1) 移动到队尾并累加计数; 首次访问记为写, 其余 weight - 1 次为读
+        if (this->occupation.record(phys_addr, timestamp, !this->occupation.contains(phys_addr), weight)) {
+            count_weighted(this->counter, false, weight);
+            record_weighted(bandwidth_engine, timestamp, false, weight);
+            return 2;
         }
-        this->counter.inc_store();
+
+        // 地址不存在，添加新条目
+        count_weighted(this->counter, true, weight);
+        record_weighted(bandwidth_engine, timestamp, true, weight);
         return 1;
     }
-    return 0;
+    this->counter.inc_store(weight);
+    return 1;
+}
+void CXLMemExpander::set_producers(size_t n) {
+    std::unique_lock lock(occupationMutex_);
+    while (ingest_queues.size() < n)
+        ingest_queues.emplace_back(std::make_unique<SPSCQueue<ingest_sample>>(INGEST_QUEUE_SIZE));
+}
+void CXLMemExpander::enqueue(size_t producer, uint64_t timestamp, uint64_t phys_addr, uint64_t weight) {
+    if (producer < ingest_queues.size() &&
+        ingest_queues[producer]->try_push({timestamp, phys_addr, weight, producer}))
+        return;
+    // 队列满或 producer 未注册时退回加锁路径, 仍由 drain 应用, 不丢样本
+    std::unique_lock lock(occupationMutex_);
+    overflow.push_back({timestamp, phys_addr, weight, producer});
+}
+size_t CXLMemExpander::drain(const sample_sink &on_sample) {
+    std::unique_lock lock(occupationMutex_);
+    auto apply_one = [&](const ingest_sample &s) {
+        int ret = apply(s.timestamp, s.phys_addr, s.weight);
+        if (s.phys_addr && on_sample)
+            on_sample(s.producer, s.timestamp, s.phys_addr, ret == 1, s.weight);
+    };
+    size_t n = 0;
+    for (auto &queue : ingest_queues)
+        n += queue->consume_all(apply_one);
+    for (const auto &s : overflow)
+        apply_one(s);
+    n += overflow.size();
+    overflow.clear();
+    return n;
+}
+size_t drain_expanders(const std::vector<CXLMemExpander *> &expanders, const device_sink &on_sample) {
+    struct drained {
+        size_t producer;
+        uint64_t timestamp;
+        uint64_t phys_addr;
+        uint64_t weight;
+        bool is_write;
+    };
+    std::vector<std::vector<drained>> applied(expanders.size());
+    std::vector<size_t> counts(expanders.size());
+    auto apply = [&](size_t d) {
+        counts[d] = expanders[d]->drain(
+            [&applied, d](size_t producer, uint64_t timestamp, uint64_t phys_addr, bool is_write, uint64_t weight) {
+                applied[d].push_back({producer, timestamp, phys_addr, weight, is_write});
+            });
+    };
+    {
+        // 每个 expander 只由一个线程应用, 第一个留在调用线程上
+        std::vector<std::jthread> workers;
+        for (size_t d = 1; d < expanders.size(); d++)
+            workers.emplace_back(apply, d);
+        if (!expanders.empty())
+            apply(0);
+    } // jthread joins here
+    size_t n = 0;
+    for (size_t d = 0; d < expanders.size(); d++) {
+        n += counts[d];
+        for (const auto &s : applied[d])
+            on_sample(d, s.producer, s.timestamp, s.phys_addr, s.is_write, s.weight);
+    }
+    return n;
 }
 std::vector<std::tuple<uint64_t, uint64_t>> CXLMemExpander::get_access(uint64_t timestamp) {
     // 原子操作更新计数器
     last_counter = CXLMemExpanderEvent(counter);
 
-    // 使用互斥锁保护对共享资源的访问
-
-    // 创建一个本地副本，减少持锁时间
     std::vector<std::tuple<uint64_t, uint64_t>> result;
-    for (const auto &it : occupation) {
-        // 如果 occupation 中的元素是指针，需要先检查指针有效性
-        if (it.timestamp > timestamp - 100000) {
-            result.emplace_back(it.timestamp, it.address);
-        }
-    }
+    for_each_access(timestamp, [&](uint64_t ts, uint64_t addr, CXLMemExpander *) { result.emplace_back(ts, addr); });
     return result;
 }
 void CXLMemExpander::set_epoch(int epoch) { this->epoch = epoch; }
-void CXLMemExpander::free_stats(double size) {
-    bool modified = false;
-
-    // 随机删除
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(0, 1);
-    for (auto it = occupation.begin(); it != occupation.end();) {
-        if (dis(gen) == 1) {
-            it = occupation.erase(it);
-            modified = true;
-        } else {
-            ++it;
-        }
-    }
-
-    // 如果有修改，重建地址缓存
-    if (modified) {
-        invalidate_cache();
-    }
+void CXLMemExpander::free_range(uint64_t addr, uint64_t length) {
+    // 只淘汰被释放的区间; 聚合模式下淘汰与之重叠的整条记录
+    if (length)
+        occupation.erase_range(addr, addr + length - 1);
 }
 
 void CXLSwitch::delete_entry(uint64_t addr, uint64_t length) {
@@ -196,245 +165,158 @@ void CXLSwitch::delete_entry(uint64_t addr, uint64_t length) {
     }
 }
 CXLSwitch::CXLSwitch(int id) : id(id) {}
-double CXLSwitch::calculate_latency(const std::vector<std::tuple<uint64_t, uint64_t>> &elem, double dramlatency) {
+void CXLSwitch::set_link(double latency, double bandwidth) {
+    link_latency = latency;
+    link_bandwidth = bandwidth;
+    uplink = BandwidthEngine(bandwidth, bandwidth);
+    // 冲突代价按链路延迟相对默认交换机延迟缩放, 重定时器和长线缆的冲突更贵
+    if (latency > 0)
+        congestion_latency = 0.02 * latency / SWITCH_LATENCY;
+}
+double CXLSwitch::calculate_latency(uint64_t timestamp, double dramlatency) {
     double lat = 0.0;
     for (auto &expander : this->expanders) {
-        lat += expander->calculate_latency(elem, dramlatency);
+        lat += expander->calculate_latency(timestamp, dramlatency);
     }
     for (auto &switch_ : this->switches) {
-        lat += switch_->calculate_latency(elem, dramlatency);
+        lat += switch_->calculate_latency(timestamp, dramlatency);
     }
     return lat;
 }
-double CXLSwitch::calculate_bandwidth(const std::vector<std::tuple<uint64_t, uint64_t>> &elem) {
+double CXLSwitch::calculate_bandwidth(uint64_t timestamp) {
     double bw = 0.0;
     for (auto &expander : this->expanders) {
-        bw += expander->calculate_bandwidth(elem);
+        bw += expander->calculate_bandwidth(timestamp);
     }
     for (auto &switch_ : this->switches) {
-        bw += switch_->calculate_bandwidth(elem);
+        bw += switch_->calculate_bandwidth(timestamp);
     }
     // time series
     return bw;
 }
-double CXLSwitch::get_endpoint_rob_latency(CXLMemExpander *endpoint,
-                                         const std::vector<std::tuple<uint64_t, uint64_t>> &accesses,
-                                         const thread_info &t_info, double dramlatency) {
+// access_count 为窗口内不属于该 endpoint 的访问数, 由调用者一次遍历统计
+double CXLSwitch::get_endpoint_rob_latency(double base_latency, size_t access_count, const thread_info &t_info,
+                                           double dramlatency) {
+    if (access_count == 0) {
+        return 0.0;
+    }
     const auto &rob = t_info.rob;
 
-    // 计算当前endpoint的基础延迟
-    double base_latency = (endpoint->latency.read + endpoint->latency.write) / 2.0;
-
     // 计算ROB相关指标
     double llc_miss_ratio = (rob.ins_count > 0) ? static_cast<double>(rob.llcm_count) / rob.ins_count : 0.0;
 
-    // 使用find替代operator[]来访问const map
     double remote_ratio = 0.0;
-    auto count_0 = rob.m_count.find(0);
-    auto count_1 = rob.m_count.find(1);
-
-    if (count_0 != rob.m_count.end() && count_1 != rob.m_count.end()) {
-        int64_t local_count = count_0->second;
-        int64_t remote_count = count_1->second;
-        if (local_count + remote_count > 0) {
-            remote_ratio = static_cast<double>(remote_count) / (local_count + remote_count);
-        }
+    int64_t local_count = rob.m_count[LLCM_LOCAL];
+    int64_t remote_count = rob.m_count[LLCM_REMOTE];
+    if (local_count + remote_count > 0) {
+        remote_ratio = static_cast<double>(remote_count) / (local_count + remote_count);
     }
 
-    // 确保地址缓存是最新的
-    endpoint->update_address_cache();
-
-    double total_latency = 0.0;
-    size_t access_count = 0;
-
-    for (const auto &[timestamp, addr] : accesses) {
-        // 使用哈希表快速检查地址是否属于这个endpoint
-        bool is_endpoint_access = endpoint->is_address_local(addr);
-
-        if (is_endpoint_access)
-            continue;
+    double current_latency = base_latency;
 
-        double current_latency = base_latency;
-        access_count++;
-
-        // ROB拥塞调整
-        if (rob.ins_count >= ROB_SIZE * 0.8) {
-            double rob_penalty = 1.0 + (llc_miss_ratio * 0.5);
-            current_latency *= rob_penalty;
-        }
-
-        // 远程访问影响
-        auto remote_count = rob.m_count.find(1);
-        if (remote_count != rob.m_count.end() && remote_count->second > 0) {
-            current_latency *= (1.0 + remote_ratio * 0.3);
-        }
-
-        // 考虑DRAM延迟
-        current_latency += dramlatency * (remote_ratio + 0.1);
-
-        total_latency += current_latency;
+    // ROB拥塞调整
+    if (rob.ins_count >= ROB_SIZE * 0.8) {
+        double rob_penalty = 1.0 + (llc_miss_ratio * 0.5);
+        current_latency *= rob_penalty;
     }
 
-    return access_count > 0 ? total_latency / access_count : 0.0;
-}
-
-std::tuple<double, std::vector<uint64_t>> CXLSwitch::calculate_congestion() {
-    double latency = 0.0;
-    std::vector<uint64_t> congestion;
-
-    // 收集所有子交换机的拥塞信息
-    for (auto &switch_ : this->switches) {
-        auto [lat, con] = switch_->calculate_congestion();
-        latency += lat;
-        // 预先分配空间以避免多次重新分配
-        congestion.reserve(congestion.size() + con.size());
-        congestion.insert(congestion.end(), con.begin(), con.end());
+    // 远程访问影响
+    if (remote_count > 0) {
+        current_latency *= (1.0 + remote_ratio * 0.3);
     }
 
-    // 使用哈希表来聚合地址访问信息，避免后续多次排序
-    struct AccessInfo {
-        std::vector<uint64_t> timestamps;
-        std::vector<bool> is_write;
-    };
+    // 考虑DRAM延迟
+    current_latency += dramlatency * (remote_ratio + 0.1);
 
-    std::unordered_map<uint64_t, AccessInfo> address_map;
-    uint64_t current_time = this->last_timestamp - epoch * 1000;
+    // 每次访问的延迟相同, 平均值即单次延迟
+    return current_latency;
+}
 
-    // 一次性收集所有访问记录
+void CXLSwitch::record_congestion(uint64_t timestamp, uint64_t phys_addr, bool is_write, bool track_address,
+                                  uint64_t weight) {
+    // 新访问只与相邻样本比较, 每个冲突只计数一次
+    if (uint64_t conflicts = congestion.record(timestamp, phys_addr, is_write, track_address, weight))
+        this->counter.inc_conflict(conflicts);
+}
+size_t CXLSwitch::drain(const sample_sink &up) {
+    // 与 insert 相同: 本层 expander 的样本参与地址冲突, 子交换机的样本只参与时间冲突
+    size_t n = 0;
     for (auto &expander : this->expanders) {
-        for (auto &it : expander->occupation) {
-            if (it.timestamp > current_time) {
-                bool is_write = it.access_count == 0;
-
-                // 直接添加到对应地址的记录中
-                address_map[it.address].timestamps.push_back(it.timestamp);
-                address_map[it.address].is_write.push_back(is_write);
-
-                congestion.push_back(it.timestamp);
-            }
-        }
-    }
-
-    // 时间冲突检测 - 使用桶排序思想
-    if (!congestion.empty()) {
-        std::sort(congestion.begin(), congestion.end());
-
-        // 使用单次遍历检测时间冲突
-        auto it = congestion.begin();
-        auto end = congestion.end() - 1;
-        while (it < end) {
-            if (*(it + 1) - *it < 2000) {
-                latency += this->congestion_latency;
-                this->counter.inc_conflict();
-                // 使用交换和弹出末尾元素代替erase，避免移动元素
-                std::swap(*it, *end);
-                congestion.pop_back();
-                end--;
-                // 不更新it，因为新交换的元素也需要检查
-            } else {
-                ++it;
-            }
-        }
+        n += expander->drain(
+            [&](size_t producer, uint64_t timestamp, uint64_t phys_addr, bool is_write, uint64_t weight) {
+                count_weighted(this->counter, is_write, weight);
+                record_congestion(timestamp, phys_addr, is_write, true, weight);
+                if (up)
+                    up(producer, timestamp, phys_addr, is_write, weight);
+            });
     }
-
-    // 读写冲突检测 - 针对每个地址只排序一次
-    for (auto& [address, info] : address_map) {
-        auto& timestamps = info.timestamps;
-        auto& is_write = info.is_write;
-
-        if (timestamps.size() <= 1) continue;
-
-        // 对时间戳和操作类型同时排序
-        std::vector<std::pair<uint64_t, bool>> sorted_access;
-        sorted_access.reserve(timestamps.size());
-
-        for (size_t i = 0; i < timestamps.size(); ++i) {
-            sorted_access.emplace_back(timestamps[i], is_write[i]);
-        }
-
-        std::sort(sorted_access.begin(), sorted_access.end());
-
-        // 单次遍历检测冲突
-        for (size_t i = 0; i < sorted_access.size() - 1; i++) {
-            const auto& current = sorted_access[i];
-            const auto& next = sorted_access[i + 1];
-
-            if (next.first - current.first < 2000) {
-                if (current.second || next.second) {
-                    if (current.second && next.second) {
-                        latency += this->congestion_latency * 2.0; // 写-写冲突
-                    } else {
-                        latency += this->congestion_latency * 1.5; // 读-写或写-读冲突
-                    }
-                    this->counter.inc_conflict();
-                } else {
-                    latency += this->congestion_latency * 0.5; // 读-读冲突
-                }
-            }
-        }
+    for (auto &switch_ : this->switches) {
+        n += switch_->drain(
+            [&](size_t producer, uint64_t timestamp, uint64_t phys_addr, bool is_write, uint64_t weight) {
+                count_weighted(this->counter, is_write, weight);
+                record_congestion(timestamp, phys_addr, is_write, false, weight);
+                if (up)
+                    up(producer, timestamp, phys_addr, is_write, weight);
+            });
     }
-
-    return std::make_tuple(latency, congestion);
+    return n;
+}
+double CXLSwitch::calculate_congestion(uint64_t timestamp) {
+    // 冲突计数在插入时已经维护好, 这里只需要滑动窗口
+    // Conflict counts are maintained on insert; a query only slides the window and sums the subtree
+    double latency = 0.0;
+    for (auto &switch_ : this->switches)
+        latency += switch_->calculate_congestion(timestamp);
+    return latency + local_congestion(timestamp);
+}
+double CXLSwitch::local_congestion(uint64_t timestamp) {
+    congestion.advance(timestamp);
+    return congestion.latency(this->congestion_latency);
 }
-
 std::vector<std::tuple<uint64_t, uint64_t>> CXLSwitch::get_access(uint64_t timestamp) {
     std::vector<std::tuple<uint64_t, uint64_t>> res;
-    size_t total_size = 0;
-    for (const auto &expander : expanders) {
-        total_size += expander->get_access(timestamp).size();
-    }
-    for (const auto &switch_ : switches) {
-        total_size += switch_->get_access(timestamp).size();
-    }
-    res.reserve(total_size);
-
-    // 直接使用 insert 合并结果
-    for (auto &expander : expanders) {
-        auto tmp = expander->get_access(timestamp);
-        res.insert(res.end(), tmp.begin(), tmp.end());
-    }
-    for (auto &switch_ : switches) {
-        auto tmp = switch_->get_access(timestamp);
-        res.insert(res.end(), tmp.begin(), tmp.end());
-    }
-
+    for_each_access(timestamp, [&](uint64_t ts, uint64_t addr, CXLMemExpander *) { res.emplace_back(ts, addr); });
     return res;
 }
-void CXLSwitch::set_epoch(int epoch) { this->epoch = epoch; }
-void CXLSwitch::free_stats(double size) {
-    // 随机删除
+void CXLSwitch::set_epoch(int epoch) {
+    this->epoch = epoch;
+    if (epoch > 0)
+        congestion.set_window(epoch * 1000);
+}
+void CXLSwitch::free_range(uint64_t addr, uint64_t length) {
     for (auto &expander : this->expanders) {
-        expander->free_stats(size);
+        expander->free_range(addr, length);
+    }
+    for (auto &switch_ : this->switches) {
+        switch_->free_range(addr, length);
     }
 }
 
-int CXLSwitch::insert(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr, int index) {
+int CXLSwitch::insert(uint64_t timestamp, uint64_t tid, uint64_t phys_addr, uint64_t virt_addr, int index,
+                      uint64_t weight) {
     // 简单示例：依次调用下属的 expander 和 switch
     SPDLOG_DEBUG("CXLSwitch insert phys_addr={}, virt_addr={}, index={} for switch id:{}", phys_addr, virt_addr, index,
                  this->id);
 
     for (auto &expander : this->expanders) {
         // 在每个 expander 上尝试插入
-        int ret = expander->insert(timestamp, tid, phys_addr, virt_addr, index);
-        if (ret == 1) {
-            this->counter.inc_store();
-            return 1;
-        }
-        if (ret == 2) {
-            this->counter.inc_load();
-            return 2;
+        int ret = expander->insert(timestamp, tid, phys_addr, virt_addr, index, weight);
+        if (ret && phys_addr)
+            record_congestion(timestamp, phys_addr, ret == 1, true, weight);
+        if (ret) {
+            count_weighted(this->counter, ret == 1, weight);
+            return ret;
         }
     }
     // 如果没有合适的 expander，就尝试下属的 switch
     for (auto &sw : this->switches) {
-        int ret = sw->insert(timestamp, tid, phys_addr, virt_addr, index);
-        if (ret == 1) {
-            this->counter.inc_store();
-            return 1;
-        }
-        if (ret == 2) {
-            this->counter.inc_load();
-            return 2;
+        int ret = sw->insert(timestamp, tid, phys_addr, virt_addr, index, weight);
+        // 子交换机的访问只参与时间冲突, 地址冲突由子交换机自己统计
+        if (ret && phys_addr)
+            record_congestion(timestamp, phys_addr, ret == 1, false, weight);
+        if (ret) {
+            count_weighted(this->counter, ret == 1, weight);
+            return ret;
         }
     }
     // 如果都处理不了，就返回0
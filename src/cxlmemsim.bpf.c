@@ -57,6 +57,14 @@ struct {
 	__type(key, u32);
 	__type(value, u32);
 } locks SEC(".maps");
+
+// 待处理的释放事件, 地址 -> {大小, 地址}, 由用户态读取后删除
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, 100000);
+	__type(key, u64);
+	__type(value, struct alloc_info);
+} frees_map SEC(".maps");
 // 钩住OpenMP并行区域创建函数
 
 // mmap的uprobe钩子
@@ -133,6 +141,8 @@ int uprobe_munmap(struct pt_regs *ctx) {
             stats->current_usage -= size;
             stats->free_count += 1;
         }
+        struct alloc_info freed = {.size = size, .address = (u64)address};
+        bpf_map_update_elem(&frees_map, &address, &freed, BPF_ANY);
         return 0;
     }
 
@@ -143,6 +153,7 @@ int uprobe_munmap(struct pt_regs *ctx) {
         stats->free_count += 1;
     }
 
+    bpf_map_update_elem(&frees_map, &address, info, BPF_ANY);
     bpf_map_delete_elem(&allocs_map, &address);
     return 0;
 }
@@ -213,6 +224,7 @@ int uprobe_free(struct pt_regs *ctx) {
         stats->free_count += 1;
     }
 
+    bpf_map_update_elem(&frees_map, &address, info, BPF_ANY);
     bpf_map_delete_elem(&allocs_map, &address);
     return 0;
 }
@@ -310,16 +322,40 @@ int uretprobe_realloc(struct pt_regs *ctx) {
         return 0;
     }
 
-    // 如果原地址存在（即不是NULL），需要先释放
+    // 原块只有在真正被释放时才发布到 frees_map, 否则用户态会淘汰仍在使用的内存
     if (info->address) {
         void *old_addr = (void *)info->address;
         struct alloc_info *old_info = bpf_map_lookup_elem(&allocs_map, &old_addr);
 
+        if (old_info && !new_addr && info->size) {
+            // realloc 失败返回 NULL, 原块保持不变
+            bpf_map_delete_elem(&allocs_map, &pid_tgid);
+            return 0;
+        }
+        if (old_info && new_addr == old_addr) {
+            // 原地伸缩: 缩小时只释放尾部, 扩大时只记录增量
+            u64 old_size = old_info->size;
+            if (info->size < old_size) {
+                struct alloc_info tail = {.size = old_size - info->size, .address = (u64)old_addr + info->size};
+                void *tail_addr = (void *)tail.address;
+                stats->total_freed += tail.size;
+                stats->current_usage -= tail.size;
+                bpf_map_update_elem(&frees_map, &tail_addr, &tail, BPF_ANY);
+            } else {
+                stats->total_allocated += info->size - old_size;
+                stats->current_usage += info->size - old_size;
+            }
+            old_info->size = info->size;
+            bpf_map_delete_elem(&allocs_map, &pid_tgid);
+            return 0;
+        }
         if (old_info) {
+            // 搬到了新地址, 或 realloc(ptr, 0) 释放了原块
             stats->total_freed += old_info->size;
             stats->current_usage -= old_info->size;
             stats->free_count += 1;
 
+            bpf_map_update_elem(&frees_map, &old_addr, old_info, BPF_ANY);
             bpf_map_delete_elem(&allocs_map, &old_addr);
         }
     }
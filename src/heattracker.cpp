@@ -0,0 +1,135 @@
+/*
+ * CXLMemSim heat tracker
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#include "heattracker.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// 缩放因子超过 2^32 时把 landmark 移到当前时刻
+static constexpr double max_half_lives = 32.0;
+
+HeatTracker::HeatTracker(size_t top_k, size_t width, size_t depth, uint64_t half_life, unsigned page_shift)
+    : capacity(std::max<size_t>(top_k, 1)), depth(std::max<size_t>(depth, 1)),
+      half_life(static_cast<double>(std::max<uint64_t>(half_life, 1))), page_shift(page_shift) {
+    size_t w = 1;
+    while (w < width)
+        w <<= 1;
+    width_mask = w - 1;
+    sketch.assign(w * this->depth, 0.0);
+    heap.reserve(capacity);
+    index.reserve(capacity + 1);
+}
+
+double HeatTracker::scale(uint64_t timestamp) const {
+    return std::exp2((static_cast<double>(timestamp) - static_cast<double>(landmark)) / half_life);
+}
+
+size_t HeatTracker::cell(size_t row, uint64_t page) const {
+    // 每行用不同的种子打散, 行之间互相独立
+    return row * (width_mask + 1) + (AddressIndex::mix(page ^ (0x9e3779b97f4a7c15ULL * (row + 1))) & width_mask);
+}
+
+void HeatTracker::rescale() {
+    double factor = 1.0 / scale(now_);
+    for (auto &c : sketch)
+        c *= factor;
+    // 所有计数乘同一个因子, 堆序不变
+    for (auto &e : heap)
+        e.count *= factor;
+    landmark = now_;
+}
+
+void HeatTracker::record(uint64_t addr, uint64_t timestamp, uint64_t weight) {
+    now_ = std::max(now_, timestamp);
+    if (now_ - landmark > max_half_lives * half_life)
+        rescale();
+
+    uint64_t page = addr >> page_shift;
+    double w = static_cast<double>(weight) * scale(timestamp);
+
+    // 保守更新: 只把各行计数器抬到 min + w
+    double est = std::numeric_limits<double>::infinity();
+    for (size_t row = 0; row < depth; row++)
+        est = std::min(est, sketch[cell(row, page)]);
+    double updated = est + w;
+    for (size_t row = 0; row < depth; row++) {
+        auto &c = sketch[cell(row, page)];
+        c = std::max(c, updated);
+    }
+
+    if (auto i = index.find(page); i != AddressIndex::npos) {
+        heap[i].count += w;
+        heap[i].addr = addr;
+        sift_down(i);
+        return;
+    }
+    if (heap.size() < capacity) {
+        // 被淘汰过的页从 sketch 中恢复历史热度
+        heap.push_back({page, addr, updated});
+        place(heap.size() - 1);
+        sift_up(heap.size() - 1);
+        return;
+    }
+    // space-saving: 顶替最冷的候选, 计数取两个高估中较小的一个
+    auto &coldest = heap.front();
+    index.erase(coldest.page);
+    coldest = {page, addr, std::min(coldest.count + w, updated)};
+    place(0);
+    sift_down(0);
+}
+
+double HeatTracker::estimate(uint64_t addr) const {
+    uint64_t page = addr >> page_shift;
+    double est = std::numeric_limits<double>::infinity();
+    for (size_t row = 0; row < depth; row++)
+        est = std::min(est, sketch[cell(row, page)]);
+    return est / scale(now_);
+}
+
+void HeatTracker::clear() {
+    std::fill(sketch.begin(), sketch.end(), 0.0);
+    heap.clear();
+    index.clear();
+    index.reserve(capacity + 1);
+    landmark = 0;
+    now_ = 0;
+}
+
+void HeatTracker::place(size_t i) { index.insert_or_assign(heap[i].page, i); }
+
+void HeatTracker::sift_up(size_t i) {
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (heap[parent].count <= heap[i].count)
+            break;
+        std::swap(heap[parent], heap[i]);
+        place(i);
+        i = parent;
+    }
+    place(i);
+}
+
+void HeatTracker::sift_down(size_t i) {
+    while (true) {
+        size_t smallest = i, l = 2 * i + 1, r = l + 1;
+        if (l < heap.size() && heap[l].count < heap[smallest].count)
+            smallest = l;
+        if (r < heap.size() && heap[r].count < heap[smallest].count)
+            smallest = r;
+        if (smallest == i)
+            break;
+        std::swap(heap[smallest], heap[i]);
+        place(i);
+        i = smallest;
+    }
+    place(i);
+}
@@ -0,0 +1,247 @@
+/*
+ * CXLMemSim host cache
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#include "hostcache.h"
+#include <algorithm>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+HostCache::HostCache(size_t entries, unsigned ways, replacement policy)
+    : ways(std::clamp(ways, 1u, 64u)), policy(policy) {
+    sets = 1;
+    while (sets * this->ways < entries)
+        sets <<= 1;
+    tags.assign(sets * this->ways, 0);
+    values.assign(sets * this->ways, 0);
+    timestamps.assign(sets * this->ways, 0);
+    state.assign(sets * this->ways, 0);
+    valid.assign(sets, 0);
+    hands.assign(sets, 0);
+}
+
+HostCache::replacement HostCache::parse(std::string_view name) {
+    if (name == "clock")
+        return replacement::CLOCK;
+    if (name == "rrip")
+        return replacement::RRIP;
+    return replacement::LRU;
+}
+
+size_t HostCache::memory_usage() const {
+    return tags.size() * (3 * sizeof(uint64_t) + sizeof(uint8_t)) + sets * (sizeof(uint64_t) + sizeof(uint8_t));
+}
+
+int HostCache::lookup(size_t set, uint64_t key) const {
+    uint64_t hit = hostcache_kernels::match(&tags[set * ways], ways, key) & valid[set];
+    return hit ? __builtin_ctzll(hit) : -1;
+}
+
+void HostCache::touch(size_t set, unsigned way) {
+    uint8_t *st = &state[set * ways];
+    switch (policy) {
+    case replacement::LRU: {
+        // 比它新的路年龄加一, 自己变成最新
+        uint8_t old = st[way];
+        for (uint64_t bits = valid[set]; bits; bits &= bits - 1) {
+            unsigned w = __builtin_ctzll(bits);
+            if (w != way && st[w] < old)
+                st[w]++;
+        }
+        st[way] = 0;
+        break;
+    }
+    case replacement::CLOCK:
+        st[way] = 1;
+        break;
+    case replacement::RRIP:
+        st[way] = 0;
+        break;
+    }
+}
+
+unsigned HostCache::victim(size_t set) {
+    uint64_t all = ways == 64 ? ~0ULL : (1ULL << ways) - 1;
+    if (uint64_t free = ~valid[set] & all)
+        return __builtin_ctzll(free);
+    uint8_t *st = &state[set * ways];
+    switch (policy) {
+    case replacement::LRU:
+        return std::max_element(st, st + ways) - st;
+    case replacement::CLOCK:
+        for (;;) {
+            unsigned hand = hands[set];
+            hands[set] = (hand + 1) % ways;
+            if (!st[hand])
+                return hand;
+            st[hand] = 0; // 给第二次机会
+        }
+    case replacement::RRIP:
+        for (;;) {
+            if (auto it = std::find(st, st + ways, 3); it != st + ways)
+                return it - st;
+            for (unsigned w = 0; w < ways; ++w)
+                st[w]++;
+        }
+    }
+    return 0;
+}
+
+std::optional<uint64_t> HostCache::get(uint64_t key, uint64_t timestamp) {
+    size_t set = set_of(key);
+    int way = lookup(set, key);
+    if (way < 0)
+        return std::nullopt; // 缓存未命中
+    mark(set);
+    touch(set, way);
+    size_t i = set * ways + way;
+    timestamps[i] = timestamp;
+    return values[i];
+}
+
+void HostCache::put(uint64_t key, uint64_t value, uint64_t timestamp) {
+    size_t set = set_of(key);
+    mark(set);
+    int way = lookup(set, key);
+    if (way < 0) {
+        way = victim(set);
+        if (!(valid[set] >> way & 1)) {
+            valid[set] |= 1ULL << way;
+            count++;
+        }
+        // 新插入的条目: LRU 视为最老再提升, RRIP 预测为较远的再引用
+        state[set * ways + way] = policy == replacement::LRU ? 255 : policy == replacement::RRIP ? 2 : 0;
+        if (policy != replacement::RRIP)
+            touch(set, way);
+    } else {
+        touch(set, way);
+    }
+    size_t i = set * ways + way;
+    tags[i] = key;
+    values[i] = value;
+    timestamps[i] = timestamp;
+}
+
+bool HostCache::remove(uint64_t key) {
+    size_t set = set_of(key);
+    int way = lookup(set, key);
+    if (way < 0)
+        return false; // 键不存在
+    mark(set);
+    valid[set] &= ~(1ULL << way);
+    count--;
+    return true;
+}
+
+void HostCache::clear() {
+    std::fill(valid.begin(), valid.end(), 0);
+    std::fill(state.begin(), state.end(), 0);
+    std::fill(hands.begin(), hands.end(), 0);
+    count = 0;
+    synced = false;
+}
+
+void HostCache::enable_journal() {
+    journaling = true;
+    synced = false;
+    dirty.assign(sets, 0);
+    dirty_sets.clear();
+}
+
+size_t HostCache::sync_to(HostCache &mirror) {
+    size_t copied;
+    if (!journaling || !synced || mirror.sets != sets || mirror.ways != ways) {
+        // 副本不带日志
+        mirror.sets = sets;
+        mirror.ways = ways;
+        mirror.policy = policy;
+        mirror.tags = tags;
+        mirror.values = values;
+        mirror.timestamps = timestamps;
+        mirror.state = state;
+        mirror.valid = valid;
+        mirror.hands = hands;
+        copied = sets;
+    } else {
+        for (auto set : dirty_sets) {
+            size_t begin = set * ways;
+            std::copy_n(&tags[begin], ways, &mirror.tags[begin]);
+            std::copy_n(&values[begin], ways, &mirror.values[begin]);
+            std::copy_n(&timestamps[begin], ways, &mirror.timestamps[begin]);
+            std::copy_n(&state[begin], ways, &mirror.state[begin]);
+            mirror.valid[set] = valid[set];
+            mirror.hands[set] = hands[set];
+        }
+        copied = dirty_sets.size();
+    }
+    mirror.count = count;
+    for (auto set : dirty_sets)
+        dirty[set] = 0;
+    dirty_sets.clear();
+    synced = true;
+    return copied;
+}
+
+namespace hostcache_kernels {
+namespace {
+uint64_t match_scalar(const uint64_t *tags, size_t ways, uint64_t key) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < ways; ++i)
+        mask |= uint64_t(tags[i] == key) << i;
+    return mask;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2"))) uint64_t match_avx2(const uint64_t *tags, size_t ways, uint64_t key) {
+    const __m256i k = _mm256_set1_epi64x(key);
+    uint64_t mask = 0;
+    size_t i = 0;
+    for (; i + 4 <= ways; i += 4) {
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(tags + i)), k);
+        mask |= uint64_t(_mm256_movemask_pd(_mm256_castsi256_pd(eq))) << i;
+    }
+    return i < ways ? mask | match_scalar(tags + i, ways - i, key) << i : mask;
+}
+__attribute__((target("avx512f"))) uint64_t match_avx512(const uint64_t *tags, size_t ways, uint64_t key) {
+    const __m512i k = _mm512_set1_epi64(key);
+    uint64_t mask = 0;
+    size_t i = 0;
+    for (; i + 8 <= ways; i += 8)
+        mask |= uint64_t(_mm512_cmpeq_epu64_mask(_mm512_loadu_si512(tags + i), k)) << i;
+    return i < ways ? mask | match_scalar(tags + i, ways - i, key) << i : mask;
+}
+#endif
+
+struct dispatch {
+    decltype(&match_scalar) match = match_scalar;
+    const char *name = "scalar";
+    dispatch() {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            match = match_avx512;
+            name = "avx512";
+        } else if (__builtin_cpu_supports("avx2")) {
+            match = match_avx2;
+            name = "avx2";
+        }
+#endif
+    }
+};
+const dispatch &kernels() {
+    static const dispatch d;
+    return d;
+}
+} // namespace
+
+uint64_t match(const uint64_t *tags, size_t ways, uint64_t key) { return kernels().match(tags, ways, key); }
+const char *name() { return kernels().name; }
+} // namespace hostcache_kernels
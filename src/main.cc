@@ -9,6 +9,7 @@
  *  UC Santa Cruz Sluglab.
  */
 #define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_OFF
+#include "controllerpool.h"
 #include "cxlendpoint.h"
 #include "helper.h"
 #include "monitor.h"
@@ -24,6 +25,7 @@
 #include <sys/poll.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <thread>
 #include <unistd.h>
 Helper helper{};
 CXLController *controller;
@@ -40,7 +42,8 @@ int main(int argc, char *argv[]) {
         "d,dramlatency", "The current platform's dram latency", cxxopts::value<double>()->default_value("110"))(
         "p,pebsperiod", "The pebs sample period", cxxopts::value<int>()->default_value("10"))(
         "m,mode", "Page mode or cacheline mode", cxxopts::value<std::string>()->default_value("p"))(
-        "o,topology", "The newick tree input for the CXL memory expander topology",
+        "o,topology",
+        "The newick tree input for the CXL memory expander topology, branch lengths as latency/bandwidth",
         cxxopts::value<std::string>()->default_value("(1,(2,3))"))(
         "q,capacity", "The capacity vector of the CXL memory expander with the first local",
         cxxopts::value<std::vector<int>>()->default_value("0,20,20,20"))(
@@ -64,7 +67,24 @@ int main(int argc, char *argv[]) {
         "k,policy", "The policy of CXL memory controller",
         cxxopts::value<std::vector<std::string>>()->default_value("none,none,none,none"))(
         "e,env", "The environment variable for the CXL memory controller",
-        cxxopts::value<std::vector<std::string>>()->default_value("OMP_NUM_THREADS=24"));
+        cxxopts::value<std::vector<std::string>>()->default_value("OMP_NUM_THREADS=24"))(
+        "granularity", "Occupation tracking granularity: address, page, hugepage or region",
+        cxxopts::value<std::string>()->default_value("address"))(
+        "memlimit", "Memory ceiling in MB for occupation tracking, 0 for unbounded",
+        cxxopts::value<size_t>()->default_value("0"))(
+        "cacheways", "Associativity of the host cache model", cxxopts::value<unsigned>()->default_value("16"))(
+        "cachereplace", "Replacement of the host cache model: lru, clock or rrip",
+        cxxopts::value<std::string>()->default_value("lru"))(
+        "policysamples", "Run migration/caching policies every N samples, 0 to disable",
+        cxxopts::value<uint64_t>()->default_value("1000"))(
+        "policyinterval", "Run migration/caching policies every N ns of trace time, 0 to disable",
+        cxxopts::value<uint64_t>()->default_value("0"))(
+        "asyncpolicy", "Run migration/caching policies on a background thread",
+        cxxopts::value<bool>()->default_value("true"))(
+        "pool", "Give every target process its own host controller sharing the expanders",
+        cxxopts::value<bool>()->default_value("false"))(
+        "migrationbudget", "Page migration bandwidth budget in MB/s, 0 for unlimited",
+        cxxopts::value<double>()->default_value("0"));
     ;
 
     auto result = options.parse(argc, argv);
@@ -89,6 +109,15 @@ int main(int argc, char *argv[]) {
     auto page_ = result["mode"].as<std::string>();
     auto policy = result["policy"].as<std::vector<std::string>>();
     auto env = result["env"].as<std::vector<std::string>>();
+    auto granularity = result["granularity"].as<std::string>();
+    auto memlimit = result["memlimit"].as<size_t>();
+    auto cacheways = result["cacheways"].as<unsigned>();
+    auto cachereplace = result["cachereplace"].as<std::string>();
+    auto policysamples = result["policysamples"].as<uint64_t>();
+    auto policyinterval = result["policyinterval"].as<uint64_t>();
+    auto asyncpolicy = result["asyncpolicy"].as<bool>();
+    auto migrationbudget = result["migrationbudget"].as<double>();
+    auto pooling = result["pool"].as<bool>();
 
     page_type mode;
     if (page_ == "hugepage_2M") {
@@ -100,66 +129,70 @@ int main(int argc, char *argv[]) {
     } else {
         mode = PAGE;
     }
-    AllocationPolicy *policy1;
-    MigrationPolicy *policy2;
-    PagingPolicy *policy3;
-    CachingPolicy *policy4;
-
-    // 初始化分配策略
-    // Initialize allocation policy
-    if (policy[0] == "interleave") {
-        policy1 = new InterleavePolicy();
-    } else if (policy[0] == "numa") {
-        policy1 = new NUMAPolicy();
-    } else {
-        policy1 = new AllocationPolicy();
-    }
+    // 每个控制器需要自己的策略实例, 内存池中的每个主机都调用一次
+    auto make_policies = [&]() -> std::array<Policy *, 4> {
+        AllocationPolicy *policy1;
+        MigrationPolicy *policy2;
+        PagingPolicy *policy3;
+        CachingPolicy *policy4;
+
+        // 初始化分配策略
+        // Initialize allocation policy
+        if (policy[0] == "interleave") {
+            policy1 = new InterleavePolicy();
+        } else if (policy[0] == "numa") {
+            policy1 = new NUMAPolicy();
+        } else {
+            policy1 = new AllocationPolicy();
+        }
 
-    // 初始化迁移策略
-    // Initialize migration policy
-    if (policy[1] == "heataware") {
-        policy2 = new HeatAwareMigrationPolicy();
-    } else if (policy[1] == "frequency") {
-        policy2 = new FrequencyBasedMigrationPolicy();
-    } else if (policy[1] == "loadbalance") {
-        policy2 = new LoadBalancingMigrationPolicy();
-    } else if (policy[1] == "locality") {
-        policy2 = new LocalityBasedMigrationPolicy();
-    } else if (policy[1] == "lifetime") {
-        policy2 = new LifetimeBasedMigrationPolicy();
-    } else if (policy[1] == "hybrid") {
-        auto *hybridPolicy = new HybridMigrationPolicy();
-        // 可以添加多个策略到混合策略中
-        // Can add multiple policies to the hybrid policy
-        hybridPolicy->add_policy(new HeatAwareMigrationPolicy());
-        hybridPolicy->add_policy(new FrequencyBasedMigrationPolicy());
-        policy2 = hybridPolicy;
-    } else {
-        SPDLOG_ERROR("Unknown migration policy: {}", policy[1]);
-        policy2 = new MigrationPolicy();
-    }
+        // 初始化迁移策略
+        // Initialize migration policy
+        if (policy[1] == "heataware") {
+            policy2 = new HeatAwareMigrationPolicy();
+        } else if (policy[1] == "frequency") {
+            policy2 = new FrequencyBasedMigrationPolicy();
+        } else if (policy[1] == "loadbalance") {
+            policy2 = new LoadBalancingMigrationPolicy();
+        } else if (policy[1] == "locality") {
+            policy2 = new LocalityBasedMigrationPolicy();
+        } else if (policy[1] == "lifetime") {
+            policy2 = new LifetimeBasedMigrationPolicy();
+        } else if (policy[1] == "hybrid") {
+            auto *hybridPolicy = new HybridMigrationPolicy();
+            // 可以添加多个策略到混合策略中
+            // Can add multiple policies to the hybrid policy
+            hybridPolicy->add_policy(new HeatAwareMigrationPolicy());
+            hybridPolicy->add_policy(new FrequencyBasedMigrationPolicy());
+            policy2 = hybridPolicy;
+        } else {
+            SPDLOG_ERROR("Unknown migration policy: {}", policy[1]);
+            policy2 = new MigrationPolicy();
+        }
 
-    // 初始化分页策略
-    // Initialize paging policy
-    if (policy[2] == "hugepage") {
-        policy3 = new HugePagePolicy();
-    } else if (policy[2] == "pagetableaware") {
-        policy3 = new PageTableAwarePolicy();
-    } else {
-        SPDLOG_ERROR("Unknown paging policy: {}", policy[2]);
-        policy3 = new PagingPolicy();
-    }
+        // 初始化分页策略
+        // Initialize paging policy
+        if (policy[2] == "hugepage") {
+            policy3 = new HugePagePolicy();
+        } else if (policy[2] == "pagetableaware") {
+            policy3 = new PageTableAwarePolicy();
+        } else {
+            SPDLOG_ERROR("Unknown paging policy: {}", policy[2]);
+            policy3 = new PagingPolicy();
+        }
 
-    // 初始化缓存策略
-    // Initialize caching policy
-    if (policy[3] == "fifo") {
-        policy4 = new FIFOPolicy();
-    } else if (policy[3] == "frequency") {
-        policy4 = new FrequencyBasedInvalidationPolicy();
-    } else {
-        SPDLOG_ERROR("Unknown caching policy: {}", policy[3]);
-        policy4 = new CachingPolicy();
-    }
+        // 初始化缓存策略
+        // Initialize caching policy
+        if (policy[3] == "fifo") {
+            policy4 = new FIFOPolicy();
+        } else if (policy[3] == "frequency") {
+            policy4 = new FrequencyBasedInvalidationPolicy();
+        } else {
+            SPDLOG_ERROR("Unknown caching policy: {}", policy[3]);
+            policy4 = new CachingPolicy();
+        }
+        return {policy1, policy2, policy3, policy4};
+    };
 
     uint64_t use_cpus = 0;
     cpu_set_t use_cpuset;
@@ -180,10 +213,13 @@ int main(int argc, char *argv[]) {
         SPDLOG_DEBUG("weight[{}]:{}", weight_vec[idx], value);
     }
 
+    // 内存池模式下 fabric 只持有共享拓扑, 每个主机另建控制器
+    CXLController *fabric = nullptr;
     for (auto const &[idx, value] : capacity | std::views::enumerate) {
         if (idx == 0) {
             SPDLOG_DEBUG("local_memory_region capacity:{}", value);
-            controller = new CXLController({policy1, policy2, policy3, policy4}, capacity[0], mode, 100, dramlatency);
+            fabric = new CXLController(pooling ? std::array<Policy *, 4>{} : make_policies(), capacity[0], mode, 100,
+                                       dramlatency);
         } else {
             SPDLOG_DEBUG("memory_region:{}", (idx - 1) + 1);
             SPDLOG_DEBUG(" capacity:{}", capacity[(idx - 1) + 1]);
@@ -193,10 +229,43 @@ int main(int argc, char *argv[]) {
             SPDLOG_DEBUG(" write_bandwidth:{}", bandwidth[(idx - 1) * 2 + 1]);
             auto *ep = new CXLMemExpander(bandwidth[(idx - 1) * 2], bandwidth[(idx - 1) * 2 + 1],
                                           latency[(idx - 1) * 2], latency[(idx - 1) * 2 + 1], idx - 1, capacity[idx]);
-            controller->insert_end_point(ep);
+            fabric->insert_end_point(ep);
         }
     }
-    controller->construct_topo(topology);
+    fabric->construct_topo(topology);
+    // 按页/大页/区域聚合 occupation, 并限制其内存占用
+    unsigned shift = 0;
+    if (granularity == "page") {
+        shift = 12;
+    } else if (granularity == "hugepage") {
+        shift = 21;
+    } else if (granularity == "region") {
+        shift = 30;
+    }
+    auto configure = [&](CXLController *c) {
+        c->set_tracking(shift, memlimit * 1024 * 1024);
+        c->host_cache = HostCache(c->host_cache.capacity(), cacheways, HostCache::parse(cachereplace));
+        c->cadence = {policysamples, policyinterval};
+        c->set_migration_budget(migrationbudget);
+        if (asyncpolicy)
+            c->start_scheduler();
+    };
+    ControllerPool *pool = nullptr;
+    if (pooling) {
+        // 共享 expander 的聚合粒度由 fabric 配置一次, 主机只配置自己的本地层
+        fabric->set_tracking(shift, memlimit * 1024 * 1024);
+        pool = new ControllerPool(
+            [&](ControllerPool *pool_) {
+                auto *host = new CXLController(make_policies(), capacity[0], mode, 100, dramlatency);
+                host->attach(pool_, fabric);
+                configure(host);
+                return host;
+            },
+            fabric);
+    } else {
+        controller = fabric;
+        configure(controller);
+    }
     /** Hove been got by socket if it's not main thread and synchro */
     SPDLOG_DEBUG("cpu_freq:{}", frequency);
     SPDLOG_DEBUG("num_of_cha:{}", ncha);
@@ -206,6 +275,8 @@ int main(int argc, char *argv[]) {
         helper.used_cha.push_back(cpuset[j]);
     }
     monitors = new Monitors{tnum, &use_cpuset};
+    /* one ingestion queue per monitor per expander */
+    fabric->set_producers(monitors->mon.size());
 
     /** Reinterpret the input for the argv argc */
     char cmd_buf[1024] = {0};
@@ -245,6 +316,8 @@ int main(int argc, char *argv[]) {
         SPDLOG_ERROR("Exec: failed to create target process");
         exit(1);
     }
+    if (pool)
+        controller = pool->host(t_process);
     /** In case of process, use SIGSTOP. */
     if (auto res = monitors->enable(t_process, t_process, true, pebsperiod, tnum); res == -1) {
         SPDLOG_ERROR("Failed to enable monitor");
@@ -297,6 +370,26 @@ int main(int argc, char *argv[]) {
 
     while (true) {
         uint64_t calibrated_delay;
+        /* read PEBS samples of all processes in parallel, then apply them at the epoch boundary */
+        {
+            std::vector<std::jthread> readers;
+            for (size_t i = 0; i < monitors->mon.size(); i++) {
+                auto &mon = monitors->mon[i];
+                auto m_status = mon.status.load();
+                if (!mon.is_process || !mon.pebs_ctx || (m_status != MONITOR_ON && m_status != MONITOR_SUSPEND))
+                    continue;
+                auto *host = pool ? pool->producer_host(i, mon.tgid) : controller;
+                readers.emplace_back([&mon, i, host] {
+                    if (mon.pebs_ctx->read(host, &mon.after->pebs) < 0) {
+                        SPDLOG_ERROR("[{}:{}:{}] Warning: Failed PEBS read", i, mon.tgid, mon.tid);
+                    }
+                });
+            }
+        } // jthread joins here
+        if (pool)
+            pool->drain();
+        else
+            controller->drain();
         for (auto const &[i, mon] : monitors->mon | std::views::enumerate) {
             // check other process
             auto m_status = mon.status.load();
@@ -304,6 +397,7 @@ int main(int argc, char *argv[]) {
                 continue;
             }
             if (m_status == MONITOR_ON || m_status == MONITOR_SUSPEND) {
+                auto *host = pool ? pool->host(mon.tgid) : controller;
                 clock_gettime(CLOCK_MONOTONIC, &start_ts);
                 SPDLOG_DEBUG("[{}:{}:{}] start_ts: {}.{}", i, mon.tgid, mon.tid, start_ts.tv_sec, start_ts.tv_nsec);
                 /** Read CHA values */
@@ -315,16 +409,12 @@ int main(int argc, char *argv[]) {
                 double writeback_latency;
                 /* read BPFTIMERUNTIME sample */
                 if (mon.is_process) {
-                    if (mon.bpftime_ctx->read(controller, &mon.after->bpftime) < 0) {
+                    if (mon.bpftime_ctx->read(host, &mon.after->bpftime) < 0) {
                         SPDLOG_ERROR("[{}:{}:{}] Warning: Failed BPFTIMERUNTIME read", i, mon.tgid, mon.tid);
                     }
 
-                    /* read PEBS sample */
-                    if (mon.pebs_ctx->read(controller, &mon.after->pebs) < 0) {
-                        SPDLOG_ERROR("[{}:{}:{}] Warning: Failed PEBS read", i, mon.tgid, mon.tid);
-                    }
                     /* read LBR sample */
-                    if (mon.lbr_ctx->read(controller, &mon.after->lbr) < 0) {
+                    if (mon.lbr_ctx->read(host, &mon.after->lbr) < 0) {
                         SPDLOG_ERROR("[{}:{}:{}] Warning: Failed LBR read", i, mon.tgid, mon.tid);
                     }
                 }
@@ -353,7 +443,7 @@ int main(int argc, char *argv[]) {
                                     (wb_cnt * target_llcmiss / (all_llcmiss + all_prefetch + 1) /
                                      (target_llchits + avg_weight * target_llcmiss + 1));
                 uint64_t emul_delay =
-                    (controller->latency_lat + controller->bandwidth_lat + writeback_latency) * 1000000;
+                    (host->latency_lat + host->bandwidth_lat + writeback_latency) * 1000000;
 
                 SPDLOG_DEBUG("[{}:{}:{}] pebs: total={}, ", i, mon.tgid, mon.tid, mon.after->pebs.total);
 
@@ -388,8 +478,8 @@ int main(int argc, char *argv[]) {
                     SPDLOG_DEBUG("{}:{}", new_wanted.tv_sec, new_wanted.tv_nsec);
                     SPDLOG_DEBUG("{}", *monitors);
                 }
-                controller->latency_lat = 0;
-                controller->bandwidth_lat = 0;
+                host->latency_lat = 0;
+                host->bandwidth_lat = 0;
             }
 
         } // End for-loop for all target processes
@@ -398,6 +488,12 @@ int main(int argc, char *argv[]) {
             break;
         }
     } // End while-loop for emulation
+    if (pool) {
+        for (auto *host : pool->hosts())
+            host->stop_scheduler();
+    } else {
+        controller->stop_scheduler();
+    }
 
     return 0;
 }
@@ -170,6 +170,7 @@ int Monitors::enable(uint32_t tgid, uint32_t tid, bool is_process, uint64_t pebs
         mon[target].bpftime_ctx = new BpfTimeRuntime(tid, "../src/cxlmemsim.json");
         /* pebs start */
         mon[target].pebs_ctx = new PEBS(tgid, pebs_sample_period);
+        mon[target].pebs_ctx->producer = target;
         SPDLOG_DEBUG("{}Process [tgid={}, tid={}]: enable to pebs.", target, mon[target].tgid,
                      mon[target].tid); // multiple tid multiple pid
         mon[target].lbr_ctx = new LBR(tgid, 1000);
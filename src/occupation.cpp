@@ -0,0 +1,544 @@
+/*
+ * CXLMemSim occupation store
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#include "occupation.h"
+#include <algorithm>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+uint64_t AddressIndex::find(uint64_t key) const {
+    if (count == 0)
+        return npos;
+    for (size_t i = mix(key) & mask;; i = (i + 1) & mask) {
+        if (slots[i].value == npos)
+            return npos;
+        if (slots[i].key == key)
+            return slots[i].value;
+    }
+}
+
+void AddressIndex::insert_or_assign(uint64_t key, uint64_t value) {
+    // 负载因子保持在 0.7 以下
+    if ((count + 1) * 10 > slots.size() * 7)
+        rehash(slots.empty() ? 16 : slots.size() * 2);
+    size_t i = mix(key) & mask;
+    while (slots[i].value != npos) {
+        if (slots[i].key == key) {
+            slots[i].value = value;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    slots[i] = {key, value};
+    count++;
+}
+
+bool AddressIndex::erase(uint64_t key) {
+    if (count == 0)
+        return false;
+    size_t i = mix(key) & mask;
+    while (true) {
+        if (slots[i].value == npos)
+            return false;
+        if (slots[i].key == key)
+            break;
+        i = (i + 1) & mask;
+    }
+    // 反向移位删除, 不留墓碑
+    // Backward shift deletion keeps probe chains intact without tombstones
+    for (size_t j = (i + 1) & mask; slots[j].value != npos; j = (j + 1) & mask) {
+        size_t k = mix(slots[j].key) & mask;
+        bool in_place = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+        if (!in_place) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i].value = npos;
+    count--;
+    return true;
+}
+
+void AddressIndex::clear() {
+    slots.clear();
+    mask = 0;
+    count = 0;
+}
+
+void AddressIndex::reserve(size_t n) {
+    size_t cap = 16;
+    while (cap * 7 < n * 10)
+        cap <<= 1;
+    if (cap > slots.size())
+        rehash(cap);
+}
+
+void AddressIndex::rehash(size_t new_capacity) {
+    std::vector<slot> old;
+    old.swap(slots);
+    slots.assign(new_capacity, slot{});
+    mask = new_capacity - 1;
+    for (const auto &s : old) {
+        if (s.value == npos)
+            continue;
+        size_t i = mix(s.key) & mask;
+        while (slots[i].value != npos)
+            i = (i + 1) & mask;
+        slots[i] = s;
+    }
+}
+
+void AddressRangeSet::insert(uint64_t addr) {
+    auto next = ranges.upper_bound(addr);
+    auto prev = next == ranges.begin() ? ranges.end() : std::prev(next);
+    if (prev != ranges.end() && prev->second >= addr)
+        return; // 已经包含
+    bool join_prev = prev != ranges.end() && prev->second + 1 == addr;
+    bool join_next = next != ranges.end() && addr != UINT64_MAX && next->first == addr + 1;
+    if (join_prev && join_next) {
+        prev->second = next->second;
+        ranges.erase(next);
+    } else if (join_prev) {
+        prev->second = addr;
+    } else if (join_next) {
+        uint64_t end = next->second;
+        ranges.emplace_hint(ranges.erase(next), addr, end);
+    } else {
+        ranges.emplace_hint(next, addr, addr);
+    }
+}
+
+void AddressRangeSet::erase(uint64_t addr) {
+    auto it = ranges.upper_bound(addr);
+    if (it == ranges.begin())
+        return;
+    --it;
+    if (it->second < addr)
+        return;
+    uint64_t start = it->first, end = it->second;
+    if (start == end) {
+        ranges.erase(it);
+    } else if (addr == start) {
+        ranges.emplace_hint(ranges.erase(it), addr + 1, end);
+    } else {
+        // 拆分区间
+        it->second = addr - 1;
+        if (addr != end)
+            ranges.emplace_hint(std::next(it), addr + 1, end);
+    }
+}
+
+bool AddressRangeSet::contains(uint64_t addr) const {
+    auto it = ranges.upper_bound(addr);
+    return it != ranges.begin() && std::prev(it)->second >= addr;
+}
+
+bool AddressRangeSet::overlaps(uint64_t start, uint64_t end) const {
+    // 最后一个起点 <= end 的区间是否覆盖到 start
+    auto it = ranges.upper_bound(end);
+    return it != ranges.begin() && std::prev(it)->second >= start;
+}
+
+std::optional<occupation_info> OccupationStore::find(uint64_t address) const {
+    auto seq = index.find(key(address));
+    if (seq == AddressIndex::npos)
+        return std::nullopt;
+    return info(slot(seq));
+}
+
+void OccupationStore::configure(unsigned shift, size_t max_bytes) {
+    if (shift != granularity_shift)
+        clear();
+    granularity_shift = shift;
+    max_entries = max_bytes == 0 ? 0 : std::max<size_t>(max_bytes / entry_bytes, 1);
+    while (max_entries && live_count > max_entries) {
+        kill(slot(head));
+        pop_dead();
+        evicted_count++;
+    }
+}
+
+bool OccupationStore::record(uint64_t address, uint64_t timestamp, bool is_write, uint64_t weight) {
+    occupation_info next{timestamp, key(address), weight, weight - is_write, is_write};
+    if (auto seq = index.find(next.address); seq != AddressIndex::npos) {
+        size_t i = slot(seq);
+        next.timestamp = std::max(timestamps[i], timestamp);
+        next.access_count += access_counts[i];
+        next.reads += reads[i];
+        next.writes += writes[i];
+    }
+    return place(next);
+}
+
+bool OccupationStore::touch(uint64_t address, uint64_t timestamp, uint64_t access_count) {
+    occupation_info next{timestamp, key(address), access_count};
+    if (auto seq = index.find(next.address); seq != AddressIndex::npos) {
+        next.reads = reads[slot(seq)];
+        next.writes = writes[slot(seq)];
+    }
+    return place(next);
+}
+
+bool OccupationStore::insert(const occupation_info &info) {
+    occupation_info next = info;
+    next.address = key(info.address);
+    return place(next);
+}
+
+bool OccupationStore::place(const occupation_info &next) {
+    auto seq = index.find(next.address);
+    bool existed = seq != AddressIndex::npos;
+    if (existed) {
+        // 地址不变, 只需让旧槽位失效, 索引在下面重新指向队尾
+        live[slot(seq)] = 0;
+        live_count--;
+    } else {
+        address_ranges.insert(next.address);
+    }
+    if (tail - head == capacity)
+        make_room();
+    uint64_t prev_max = tail > head ? max_timestamps[slot(tail - 1)] : 0;
+    size_t i = slot(tail);
+    timestamps[i] = next.timestamp;
+    addresses[i] = next.address;
+    access_counts[i] = next.access_count;
+    reads[i] = next.reads;
+    writes[i] = next.writes;
+    max_timestamps[i] = std::max(prev_max, next.timestamp);
+    live[i] = 1;
+    index.insert_or_assign(next.address, tail);
+    tail++;
+    live_count++;
+    log(next.address);
+    // 超过内存上限时淘汰最久未访问的记录, 队头就是最久未访问的
+    if (max_entries && live_count > max_entries) {
+        pop_dead();
+        kill(slot(head));
+        pop_dead();
+        evicted_count++;
+    }
+    return existed;
+}
+
+bool OccupationStore::erase(uint64_t address) {
+    auto seq = index.find(key(address));
+    if (seq == AddressIndex::npos)
+        return false;
+    kill(slot(seq));
+    pop_dead();
+    return true;
+}
+
+size_t OccupationStore::erase_range(uint64_t lo, uint64_t hi) {
+    if (!overlaps(lo, hi))
+        return 0;
+    // 先收集再删除, 遍历期间不修改区间集合
+    std::vector<uint64_t> doomed;
+    address_ranges.for_each_in(key(lo), key(hi), [&](uint64_t address) { doomed.push_back(address); });
+    for (auto address : doomed)
+        kill(slot(index.find(address)));
+    pop_dead();
+    return doomed.size();
+}
+
+size_t OccupationStore::subscribe() {
+    journal_cursors.push_back(unsynced);
+    journal_readers++;
+    return journal_cursors.size() - 1;
+}
+
+void OccupationStore::unsubscribe(size_t reader) {
+    if (journal_cursors[reader] == detached)
+        return;
+    journal_cursors[reader] = detached;
+    if (--journal_readers == 0)
+        trim_journal(journal.size());
+}
+
+size_t OccupationStore::sync_to(OccupationStore &mirror, size_t reader) {
+    uint64_t &cursor = journal_cursors[reader];
+    uint64_t end = journal_base + journal.size();
+    size_t replayed;
+    if (cursor == unsynced || cursor < journal_base || mirror.granularity_shift != granularity_shift) {
+        // 第一次同步或日志已被截断: 整体复制, 副本不带日志也不设上限, 淘汰由日志中的删除体现
+        mirror.timestamps = timestamps;
+        mirror.addresses = addresses;
+        mirror.access_counts = access_counts;
+        mirror.reads = reads;
+        mirror.writes = writes;
+        mirror.max_timestamps = max_timestamps;
+        mirror.live = live;
+        mirror.capacity = capacity;
+        mirror.mask = mask;
+        mirror.head = head;
+        mirror.tail = tail;
+        mirror.live_count = live_count;
+        mirror.index = index;
+        mirror.address_ranges = address_ranges;
+        mirror.granularity_shift = granularity_shift;
+        mirror.max_entries = 0;
+        mirror.evicted_count = evicted_count;
+        replayed = live_count;
+    } else {
+        // 按改动顺序重放, 每个键最后一次移到队尾的位置与源相同, 副本的时间顺序也就相同
+        replayed = end - cursor;
+        for (uint64_t seq = cursor; seq < end; ++seq) {
+            uint64_t address = journal[seq - journal_base];
+            if (auto seq_in = index.find(address); seq_in != AddressIndex::npos)
+                mirror.place(info(slot(seq_in)));
+            else
+                mirror.erase(address);
+        }
+        mirror.evicted_count = evicted_count;
+    }
+    cursor = end;
+
+    // 丢弃所有订阅者都已重放过的前缀
+    uint64_t oldest = end;
+    for (auto c : journal_cursors) {
+        if (c < detached)
+            oldest = std::min(oldest, c);
+    }
+    if (oldest > journal_base)
+        trim_journal(oldest - journal_base);
+    return replayed;
+}
+
+void OccupationStore::trim_journal(size_t n) {
+    n = std::min(n, journal.size());
+    journal.erase(journal.begin(), journal.begin() + n);
+    journal_base += n;
+}
+
+void OccupationStore::clear() {
+    timestamps.clear();
+    addresses.clear();
+    access_counts.clear();
+    reads.clear();
+    writes.clear();
+    max_timestamps.clear();
+    live.clear();
+    capacity = 0;
+    mask = 0;
+    head = tail = 0;
+    live_count = 0;
+    index.clear();
+    address_ranges.clear();
+    // 所有订阅者都需要整体复制
+    trim_journal(journal.size());
+    for (auto &c : journal_cursors) {
+        if (c != detached)
+            c = unsynced;
+    }
+}
+
+size_t OccupationStore::count_since(uint64_t timestamp) const {
+    size_t count = 0;
+    for (uint64_t seq = lower_bound(timestamp); seq < tail;) {
+        size_t begin = slot(seq);
+        size_t n = std::min<uint64_t>(tail - seq, capacity - begin);
+        count += occupation_kernels::count_since(&timestamps[begin], &live[begin], n, timestamp);
+        seq += n;
+    }
+    return count;
+}
+
+uint64_t OccupationStore::lower_bound(uint64_t timestamp) const {
+    // 第一个前缀最大值 > timestamp 的位置, 之前的条目都不可能落在窗口内
+    uint64_t lo = head, hi = tail;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (max_timestamps[slot(mid)] > timestamp)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+void OccupationStore::kill(size_t i) {
+    log(addresses[i]);
+    live[i] = 0;
+    index.erase(addresses[i]);
+    address_ranges.erase(addresses[i]);
+    live_count--;
+}
+
+void OccupationStore::pop_dead() {
+    while (head < tail && !live[slot(head)])
+        head++;
+}
+
+void OccupationStore::make_room() {
+    pop_dead();
+    size_t used = tail - head;
+    if (used < capacity)
+        return;
+    // 墓碑过半时原地压缩, 否则扩容一倍; 两者都是均摊 O(1)
+    // Compact when at least half the slots are tombstones, otherwise double the ring
+    size_t new_size = capacity == 0 ? 16 : (live_count * 2 <= used ? capacity : capacity * 2);
+    std::vector<uint64_t> new_timestamps(new_size), new_addresses(new_size), new_access_counts(new_size),
+        new_reads(new_size), new_writes(new_size), new_max_timestamps(new_size);
+    std::vector<uint8_t> new_live(new_size, 0);
+    uint64_t out = 0, prev_max = 0;
+    for (uint64_t seq = head; seq < tail; ++seq) {
+        size_t i = slot(seq);
+        if (!live[i])
+            continue;
+        prev_max = std::max(prev_max, timestamps[i]);
+        new_timestamps[out] = timestamps[i];
+        new_addresses[out] = addresses[i];
+        new_access_counts[out] = access_counts[i];
+        new_reads[out] = reads[i];
+        new_writes[out] = writes[i];
+        new_max_timestamps[out] = prev_max;
+        new_live[out] = 1;
+        index.insert_or_assign(addresses[i], out);
+        out++;
+    }
+    timestamps.swap(new_timestamps);
+    addresses.swap(new_addresses);
+    access_counts.swap(new_access_counts);
+    reads.swap(new_reads);
+    writes.swap(new_writes);
+    max_timestamps.swap(new_max_timestamps);
+    live.swap(new_live);
+    capacity = new_size;
+    mask = new_size - 1;
+    head = 0;
+    tail = out;
+}
+
+namespace occupation_kernels {
+namespace {
+// 标量实现, 也用于处理向量内核剩下的尾部
+size_t select_since_scalar(const uint64_t *ts, const uint8_t *live, size_t n, uint64_t after, uint32_t *out) {
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i) {
+        out[k] = i;
+        k += live[i] & (ts[i] > after); // 无分支写入
+    }
+    return k;
+}
+size_t count_since_scalar(const uint64_t *ts, const uint8_t *live, size_t n, uint64_t after) {
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i)
+        k += live[i] & (ts[i] > after);
+    return k;
+}
+
+#if defined(__x86_64__)
+inline size_t emit(uint32_t bits, size_t base, uint32_t *out, size_t k) {
+    while (bits) {
+        out[k++] = base + __builtin_ctz(bits);
+        bits &= bits - 1;
+    }
+    return k;
+}
+
+// AVX2 没有无符号 64 位比较, 翻转符号位后用有符号比较
+__attribute__((target("avx2"))) inline uint32_t live_mask_avx2(const uint8_t *live) {
+    uint32_t bytes;
+    __builtin_memcpy(&bytes, live, sizeof(bytes));
+    __m256i l = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(bytes));
+    return ~_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(l, _mm256_setzero_si256()))) & 0xf;
+}
+__attribute__((target("avx2"))) inline uint32_t since_mask_avx2(const uint64_t *ts, const uint8_t *live,
+                                                               __m256i after, __m256i sign) {
+    __m256i t = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(ts)), sign);
+    return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(t, after))) & live_mask_avx2(live);
+}
+
+__attribute__((target("avx2"))) size_t select_since_avx2(const uint64_t *ts, const uint8_t *live, size_t n,
+                                                          uint64_t after, uint32_t *out) {
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i a = _mm256_xor_si256(_mm256_set1_epi64x(after), sign);
+    size_t i = 0, k = 0;
+    for (; i + 4 <= n; i += 4)
+        k = emit(since_mask_avx2(ts + i, live + i, a, sign), i, out, k);
+    size_t rest = select_since_scalar(ts + i, live + i, n - i, after, out + k);
+    for (size_t j = k; j < k + rest; ++j)
+        out[j] += i;
+    return k + rest;
+}
+__attribute__((target("avx2,popcnt"))) size_t count_since_avx2(const uint64_t *ts, const uint8_t *live, size_t n,
+                                                                 uint64_t after) {
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i a = _mm256_xor_si256(_mm256_set1_epi64x(after), sign);
+    size_t i = 0, k = 0;
+    for (; i + 4 <= n; i += 4)
+        k += __builtin_popcount(since_mask_avx2(ts + i, live + i, a, sign));
+    return k + count_since_scalar(ts + i, live + i, n - i, after);
+}
+
+// AVX-512 直接支持无符号比较和掩码寄存器
+__attribute__((target("avx512f"))) inline __mmask8 live_mask_avx512(const uint8_t *live) {
+    __m512i l = _mm512_maskz_cvtepu8_epi64(0xff, _mm_loadl_epi64(reinterpret_cast<const __m128i *>(live)));
+    return _mm512_test_epi64_mask(l, l);
+}
+__attribute__((target("avx512f"))) size_t select_since_avx512(const uint64_t *ts, const uint8_t *live, size_t n,
+                                                               uint64_t after, uint32_t *out) {
+    const __m512i a = _mm512_set1_epi64(after);
+    size_t i = 0, k = 0;
+    for (; i + 8 <= n; i += 8) {
+        __mmask8 m = _mm512_mask_cmpgt_epu64_mask(live_mask_avx512(live + i), _mm512_loadu_si512(ts + i), a);
+        k = emit(m, i, out, k);
+    }
+    size_t rest = select_since_scalar(ts + i, live + i, n - i, after, out + k);
+    for (size_t j = k; j < k + rest; ++j)
+        out[j] += i;
+    return k + rest;
+}
+__attribute__((target("avx512f,popcnt"))) size_t count_since_avx512(const uint64_t *ts, const uint8_t *live,
+                                                                      size_t n, uint64_t after) {
+    const __m512i a = _mm512_set1_epi64(after);
+    size_t i = 0, k = 0;
+    for (; i + 8 <= n; i += 8)
+        k += __builtin_popcount(
+            _mm512_mask_cmpgt_epu64_mask(live_mask_avx512(live + i), _mm512_loadu_si512(ts + i), a));
+    return k + count_since_scalar(ts + i, live + i, n - i, after);
+}
+#endif
+
+struct dispatch {
+    decltype(&select_since_scalar) select_since = select_since_scalar;
+    decltype(&count_since_scalar) count_since = count_since_scalar;
+    const char *name = "scalar";
+    dispatch() {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            select_since = select_since_avx512;
+            count_since = count_since_avx512;
+            name = "avx512";
+        } else if (__builtin_cpu_supports("avx2")) {
+            select_since = select_since_avx2;
+            count_since = count_since_avx2;
+            name = "avx2";
+        }
+#endif
+    }
+};
+const dispatch &kernels() {
+    static const dispatch d;
+    return d;
+}
+} // namespace
+
+size_t select_since(const uint64_t *timestamps, const uint8_t *live, size_t n, uint64_t after, uint32_t *out) {
+    return kernels().select_since(timestamps, live, n, after, out);
+}
+size_t count_since(const uint64_t *timestamps, const uint8_t *live, size_t n, uint64_t after) {
+    return kernels().count_since(timestamps, live, n, after);
+}
+const char *name() { return kernels().name; }
+} // namespace occupation_kernels
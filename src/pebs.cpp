@@ -97,7 +97,7 @@ int PEBS::read(CXLController *controller, PEBSElem *elem) {
                     SPDLOG_TRACE("pid:{} tid:{} time:{} addr:{} phys_addr:{} llc_miss:{} timestamp={}\n", data->pid,
                                  data->tid, data->time_enabled, data->addr, data->phys_addr, data->value,
                                  data->timestamp);
-                    controller->insert(data->timestamp, data->tid, data->phys_addr, data->addr, data->value);
+                    batch.push_back({data->timestamp, data->tid, data->phys_addr, data->addr, (int)data->value});
                     elem->total++;
                     elem->llcmiss = data->value; // this is the number of llc miss
                 }
@@ -123,6 +123,13 @@ int PEBS::read(CXLController *controller, PEBSElem *elem) {
         barrier();
     } while (mp->lock != this->seq);
 
+    if (!batch.empty()) {
+        if (producer >= 0)
+            controller->insert_concurrent(producer, batch);
+        else
+            controller->insert(batch);
+        batch.clear();
+    }
     return r;
 }
 int PEBS::start() const {
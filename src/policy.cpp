@@ -10,128 +10,178 @@
  */
 
 #include "policy.h"
+#include <algorithm>
+#include <cmath>
 #include <numeric>
 PagingPolicy::PagingPolicy() = default;
 CachingPolicy::CachingPolicy() = default;
 AllocationPolicy::AllocationPolicy() = default;
+// size * per_size / 1MB < capacity 成立的最大记录数, 预先算好后每次只比较 size
+static uint64_t entries_below(double capacity, uint64_t per_size) {
+    uint64_t bytes = static_cast<uint64_t>(std::ceil(capacity)) * 1024 * 1024;
+    return (bytes + per_size - 1) / per_size;
+}
+void InterleavePolicy::build(CXLController *controller) {
+    uint64_t per_size = page_bytes(controller->page_type_);
+    built_for = controller->page_type_;
+    local_limit = entries_below(controller->capacity * 0.9, per_size);
+
+    // 权重取带宽 (受路径上最窄的链路限制) 与路径延迟之比
+    auto attached = controller->topology.devices();
+    devices.assign(attached.begin(), attached.end());
+    std::vector<double> score;
+    for (int d : devices) {
+        auto *expander = controller->cur_expanders[d];
+        double bandwidth = std::min((expander->bandwidth.read + expander->bandwidth.write) / 2.0,
+                                    controller->topology.bandwidth(d));
+        score.push_back(bandwidth / std::max(controller->topology.latency(d), 1.0));
+    }
+    double best = score.empty() ? 0.0 : *std::max_element(score.begin(), score.end());
+    weights.clear();
+    uint32_t g = 0;
+    for (double s : score) {
+        uint32_t w = best > 0 ? std::max<long>(1, std::lround(s / best * INTERLEAVE_MAX_WEIGHT)) : 1;
+        weights.push_back(w);
+        g = std::gcd(g, w);
+    }
+
+    cumulative.assign(1, 0);
+    slot_owner.clear();
+    limits.clear();
+    for (size_t i = 0; i < devices.size(); i++) {
+        weights[i] /= g;
+        slot_owner.insert(slot_owner.end(), weights[i], static_cast<uint32_t>(i));
+        cumulative.push_back(slot_owner.size());
+        limits.push_back(entries_below(controller->cur_expanders[devices[i]]->capacity, per_size));
+    }
+    cursor = 0;
+    built = true;
+}
 // If the number is -1 for local, else it is the index of the remote server
 int InterleavePolicy::compute_once(CXLController *controller) {
-    int per_size;
-    switch (controller->page_type_) {
-    case CACHELINE:
-        per_size = 64;
-        break;
-    case PAGE:
-        per_size = 4096;
-        break;
-    case HUGEPAGE_2M:
-        per_size = 2 * 1024 * 1024;
-        break;
-    case HUGEPAGE_1G:
-        per_size = 1024 * 1024 * 1024;
-        break;
-    };
-    if (controller->occupation.size() * per_size / 1024 / 1024 < controller->capacity * 0.9) {
+    if (!built || built_for != controller->page_type_ || devices.size() != controller->topology.devices().size())
+        build(controller);
+    if (controller->occupation.size() < local_limit || slot_owner.empty())
         return -1;
-    } else {
-        if (this->percentage.empty()) {
-            // Here to compute the distributor statically using geometry average of write latency
-            std::vector<double> to_store;
-            for (auto &i : controller->cur_expanders) {
-                to_store.push_back(1 / i->latency.write);
-            }
-            for (auto &i : to_store) {
-                this->percentage.push_back(int(i / std::accumulate(to_store.begin(), to_store.end(), 0.0) * 10));
-            }
-            this->all_size = std::accumulate(this->percentage.begin(), this->percentage.end(), 0);
+    // 从当前槽开始选择; 已满的设备整段跳过, 最多检查每个设备一次
+    for (size_t tried = 0; tried < devices.size(); tried++) {
+        uint32_t i = slot_owner[cursor];
+        if (controller->cur_expanders[devices[i]]->occupation.size() < limits[i]) {
+            cursor = (cursor + 1) % slot_owner.size();
+            return devices[i];
         }
-    next:
-        last_remote = (last_remote + 1) % all_size;
-        int sum, index;
-        for (index = 0, sum = 0; sum <= last_remote; index++) { // 5 2 2 to get the next
-            sum += this->percentage[index];
-            if (sum > last_remote) {
-                if (controller->cur_expanders[index]->occupation.size() * per_size / 1024 / 1024 <
-                    controller->cur_expanders[index]->capacity) {
-                    break;
-                } else {
-                    /** TODO: capacity bound */
-                    goto next;
-                }
-            }
-        }
-        return index;
+        cursor = cumulative[i + 1] % slot_owner.size();
     }
+    // 所有 expander 都已满, 退回本地内存
+    return -1;
+}
+bool NUMAPolicy::full(CXLController *controller, int device) const {
+    return controller->cur_expanders[device]->occupation.size() >= limits[device];
 }
-int NUMAPolicy::compute_once(CXLController *controller) {
-    int per_size;
-    // 确定页面大小
-    switch (controller->page_type_) {
-    case CACHELINE:
-        per_size = 64;
-        break;
-    case PAGE:
-        per_size = 4096;
-        break;
-    case HUGEPAGE_2M:
-        per_size = 2 * 1024 * 1024;
-        break;
-    case HUGEPAGE_1G:
-        per_size = 1024 * 1024 * 1024;
-        break;
-    };
 
-    // 检查本地内存是否有足够空间
-    if (controller->occupation.size() * per_size / 1024 / 1024 < controller->capacity * 0.9) {
-        return -1; // 返回-1表示使用本地内存
-    }
+void NUMAPolicy::refresh(CXLController *controller, uint64_t timestamp) {
+    uint64_t per_size = page_bytes(controller->page_type_);
+    local_limit = entries_below(controller->capacity * 0.9, per_size);
+    const auto &expanders = controller->cur_expanders;
+    const auto &topology = controller->topology;
+    limits.assign(expanders.size(), 0);
+    last_accesses.resize(expanders.size(), 0);
+    loaded_latency.assign(expanders.size(), Topology::unlimited);
 
-    // 初始化延迟评分
-    if (this->latency_scores.empty()) {
-        for (size_t i = 0; i < controller->cur_expanders.size(); i++) {
-            // 计算综合延迟分数：考虑读写延迟的加权平均
-            double read_weight = 0.7; // 读操作权重
-            double write_weight = 0.3; // 写操作权重
-            double latency_score = 1.0 / (read_weight * controller->cur_expanders[i]->latency.read +
-                                          write_weight * controller->cur_expanders[i]->latency.write);
-            latency_scores.push_back(latency_score);
-        }
-    }
+    double elapsed = refreshed && timestamp > last_refresh ? static_cast<double>(timestamp - last_refresh) : 0.0;
+    for (int d : topology.devices()) {
+        auto *expander = expanders[d];
+        limits[d] = entries_below(expander->capacity, per_size);
 
-    // 寻找最佳节点
-    int best_node = -1;
-    double best_score = -1;
+        // 利用率: 上次估计以来的访问字节数 / 时间 (B/ns 即 GB/s) 与路径带宽之比
+        uint64_t accesses = expander->counter.load.get() + expander->counter.store.get();
+        uint64_t delta = accesses >= last_accesses[d] ? accesses - last_accesses[d] : accesses;
+        last_accesses[d] = accesses;
+        double bandwidth =
+            std::min((expander->bandwidth.read + expander->bandwidth.write) / 2.0, topology.bandwidth(d));
+        double utilization = 0.0;
+        if (elapsed > 0 && bandwidth > 0)
+            utilization = std::min(delta * CACHELINE_SIZE / elapsed / bandwidth, NUMA_MAX_UTILIZATION);
 
-    for (size_t i = 0; i < controller->cur_expanders.size(); i++) {
-        // 检查节点是否有足够容量
-        if (controller->cur_expanders[i]->occupation.size() * per_size / 1024 / 1024 >=
-            controller->cur_expanders[i]->capacity) {
-            continue; // 跳过已满的节点
-        }
+        // 排队: 设备和路径上各链路的令牌桶中尚未排空的等待, 根端口没有上游链路
+        double wait = expander->bandwidth_engine.delay_at(timestamp) + expander->uplink.delay_at(timestamp);
+        auto path = topology.path(d);
+        for (size_t i = 0; i + 1 < path.size(); i++)
+            wait += topology.switches()[path[i]]->uplink.delay_at(timestamp);
 
-        // 计算节点评分
-        double current_score =
-            latency_scores[i] * (1.0 - static_cast<double>(controller->cur_expanders[i]->occupation.size() * per_size) /
-                                           (controller->cur_expanders[i]->capacity * 1024 * 1024));
+        loaded_latency[d] = topology.latency(d) / (1.0 - utilization) + wait;
+    }
+    last_refresh = timestamp;
+    refreshed = true;
+}
 
-        // 更新最佳节点
-        if (current_score > best_score) {
-            best_score = current_score;
-            best_node = i;
-        }
+int NUMAPolicy::choose(CXLController *controller) {
+    int best = -1;
+    for (int d : controller->topology.devices()) {
+        if (!full(controller, d) && (best < 0 || loaded_latency[d] < loaded_latency[best]))
+            best = d;
     }
+    // 滞后: 当前设备未满且新设备没有快出 hysteresis 时不切换
+    if (best >= 0 && preferred >= 0 && preferred != best && (size_t)preferred < limits.size() &&
+        !full(controller, preferred) && loaded_latency[best] >= loaded_latency[preferred] * (1.0 - hysteresis))
+        best = preferred;
+    // 所有 expander 都满时退回本地
+    preferred = best;
+    return best;
+}
 
-    // 如果找不到合适的节点，返回第一个未满的节点
-    if (best_node == -1) {
-        for (size_t i = 0; i < controller->cur_expanders.size(); i++) {
-            if (controller->cur_expanders[i]->occupation.size() * per_size / 1024 / 1024 <
-                controller->cur_expanders[i]->capacity) {
-                return i;
-            }
-        }
+int NUMAPolicy::decide(CXLController *controller, uint64_t timestamp) {
+    if (!refreshed || timestamp >= last_refresh + refresh_interval)
+        refresh(controller, timestamp);
+    if (controller->occupation.size() < local_limit)
+        return -1; // 返回-1表示使用本地内存
+    return choose(controller);
+}
+
+int NUMAPolicy::compute_once(CXLController *controller) { return decide(controller, last_refresh); }
+
+int NUMAPolicy::place(CXLController *controller, uint64_t timestamp, uint64_t phys_addr) {
+    uint64_t page = phys_addr / page_bytes(controller->page_type_);
+    // 已放置的页留在原设备, 只有原设备满了才重新选择
+    auto it = placement.find(page);
+    if (it != placement.end() && (it->second < 0 || !full(controller, it->second)))
+        return it->second;
+    int device = decide(controller, timestamp);
+    if (it != placement.end()) {
+        it->second = device;
+    } else {
+        if (placement.size() >= NUMA_PLACEMENT_CACHE)
+            placement.clear();
+        placement.emplace(page, device);
     }
+    return device;
+}
 
-    return best_node;
+// HeatAwareMigrationPolicy实现
+void HeatAwareMigrationPolicy::observe_access(uint64_t addr, uint64_t timestamp, uint64_t weight) {
+    std::lock_guard lock(mutex_);
+    heat.record(addr, timestamp, weight);
+}
+
+double HeatAwareMigrationPolicy::heat_of(uint64_t addr) const {
+    std::lock_guard lock(mutex_);
+    return heat.estimate(addr);
+}
+
+int HeatAwareMigrationPolicy::compute_once(CXLController *controller) {
+    return get_migration_list(controller).empty() ? 0 : 1;
+}
+
+std::vector<std::tuple<uint64_t, uint64_t>> HeatAwareMigrationPolicy::get_migration_list(CXLController *controller) {
+    std::vector<std::tuple<uint64_t, uint64_t>> to_migrate;
+    uint64_t per_size = page_bytes(controller->page_type_);
+    std::lock_guard lock(mutex_);
+    heat.for_each_hot(static_cast<double>(hot_threshold), [&](uint64_t addr, double) {
+        // 已在本地的页不再迁移, 否则 migrate 会把它移回 expander
+        if (!controller->occupation.contains(addr))
+            to_migrate.emplace_back(addr, per_size);
+    });
+    return to_migrate;
 }
 
 // FIFOPolicy实现
@@ -155,26 +205,27 @@ int FIFOPolicy::compute_once(CXLController *controller) {
     };
 
     // 检查缓存是否已满
-    if (controller->lru_cache.size() * per_size / 1024 / 1024 >= controller->capacity) {
-        // 找到时间戳最小的条目（最早插入的）
-        uint64_t oldest_timestamp = UINT64_MAX;
-        uint64_t oldest_phys_addr = 0;
-
-        for (const auto& [addr, entry] : controller->lru_cache.cache) {
-            if (entry.timestamp < oldest_timestamp) {
-                oldest_timestamp = entry.timestamp;
-                oldest_phys_addr = addr;
-            }
-        }
+    size_t limit = static_cast<size_t>(std::max(controller->capacity, 0));
+    return controller->host_cache.size() * per_size / 1024 / 1024 >= limit ? 1 : 0;
+}
+std::vector<uint64_t> FIFOPolicy::get_invalidation_list(CXLController *controller) {
+    if (!compute_once(controller))
+        return {};
+    // 找到时间戳最小的条目（最早插入的）, 由控制器执行驱逐
+    uint64_t oldest_timestamp = UINT64_MAX;
+    uint64_t oldest_phys_addr = 0;
 
-        if (oldest_phys_addr != 0) {
-            controller->lru_cache.remove(oldest_phys_addr);
-            return 1;  // 返回1表示进行了页面驱逐
+    controller->host_cache.for_each([&](uint64_t addr, const LRUCacheEntry &entry) {
+        if (entry.timestamp < oldest_timestamp) {
+            oldest_timestamp = entry.timestamp;
+            oldest_phys_addr = addr;
         }
-    }
-    return 0;  // 返回0表示没有进行驱逐
+    });
+    if (oldest_phys_addr == 0)
+        return {};
+    return {oldest_phys_addr};
 }
-bool FrequencyBasedInvalidationPolicy::should_invalidate(uint64_t addr, uint64_t timestamp) {
+bool FrequencyBasedInvalidationPolicy::below_threshold(uint64_t addr) const {
     // 根据访问频率决定是否应该失效
     auto it = access_count.find(addr);
     if (it != access_count.end()) {
@@ -182,15 +233,20 @@ bool FrequencyBasedInvalidationPolicy::should_invalidate(uint64_t addr, uint64_t
     }
     return false;
 }
+bool FrequencyBasedInvalidationPolicy::should_invalidate(uint64_t addr, uint64_t timestamp) {
+    std::lock_guard lock(mutex_);
+    return below_threshold(addr);
+}
 std::vector<uint64_t> FrequencyBasedInvalidationPolicy::get_invalidation_list(CXLController* controller){
     std::vector<uint64_t> to_invalidate;
+    std::lock_guard lock(mutex_);
 
     // 遍历缓存查找低频访问的地址
-    for (const auto& [addr, entry] : controller->lru_cache.cache) {
-        if (should_invalidate(addr, 0)) {
+    controller->host_cache.for_each([&](uint64_t addr, const LRUCacheEntry &) {
+        if (below_threshold(addr)) {
             to_invalidate.push_back(addr);
         }
-    }
+    });
 
     // 清理访问计数（周期性）
     uint64_t current_time = controller->last_timestamp;
@@ -203,6 +259,7 @@ std::vector<uint64_t> FrequencyBasedInvalidationPolicy::get_invalidation_list(CX
 }
 bool FrequencyBasedInvalidationPolicy::should_cache(uint64_t addr, uint64_t timestamp) {
     // 记录访问
+    std::lock_guard lock(mutex_);
     access_count[addr]++;
     return true; // 总是缓存
 }
@@ -0,0 +1,170 @@
+/*
+ * CXLMemSim policy scheduler
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#include "policyscheduler.h"
+
+PolicyScheduler::PolicyScheduler(CXLController *controller, policy_cadence cadence)
+    : controller(controller), default_cadence(cadence) {
+    // 影子控制器不持有策略, 只提供策略读取的状态
+    snapshot = std::make_unique<CXLController>(std::array<Policy *, 4>{}, controller->capacity,
+                                               controller->page_type_, controller->epoch, controller->dramlatency);
+    for (auto *expander : controller->cur_expanders) {
+        auto copy = std::make_unique<CXLMemExpander>(expander->bandwidth.read, expander->bandwidth.write,
+                                                     expander->latency.read, expander->latency.write, expander->id,
+                                                     expander->capacity);
+        snapshot->insert_end_point(copy.get());
+        snapshot_expanders.push_back(std::move(copy));
+    }
+    for (auto *expander : controller->expanders)
+        snapshot->expanders.push_back(snapshot_expanders[expander->id].get());
+    // 策略只按设备 id 遍历拓扑, 交换机指针仍指向真实拓扑, 影子控制器不会访问
+    snapshot->topology = controller->topology;
+    // 影子副本之后只重放日志中的改动
+    local_reader = controller->occupation.subscribe();
+    for (auto *expander : controller->cur_expanders) {
+        std::unique_lock lock(expander->occupationMutex_);
+        expander_readers.push_back(expander->occupation.subscribe());
+    }
+    controller->host_cache.enable_journal();
+    worker = std::jthread([this](std::stop_token stop) { run(stop); });
+}
+
+PolicyScheduler::~PolicyScheduler() {
+    worker.request_stop();
+    if (worker.joinable())
+        worker.join();
+    controller->occupation.unsubscribe(local_reader);
+    for (size_t i = 0; i < expander_readers.size(); i++) {
+        auto *expander = controller->cur_expanders[i];
+        std::unique_lock lock(expander->occupationMutex_);
+        expander->occupation.unsubscribe(expander_readers[i]);
+    }
+}
+
+Policy *PolicyScheduler::policy_of(int s) const {
+    if (s == MIGRATION)
+        return controller->migration_policy;
+    return controller->caching_policy;
+}
+
+bool PolicyScheduler::is_due(int s, uint64_t timestamp) const {
+    auto cadence = policy_of(s)->cadence();
+    if (!cadence.samples && !cadence.interval)
+        cadence = default_cadence;
+    const auto &sched = schedules[s];
+    return (cadence.samples && sched.samples >= cadence.samples) ||
+           (cadence.interval && timestamp - sched.last_run >= cadence.interval);
+}
+
+size_t PolicyScheduler::poll(uint64_t samples, uint64_t timestamp) {
+    size_t applied = apply();
+    unsigned mask = 0;
+    for (int s = 0; s < SLOTS; s++) {
+        if (!policy_of(s))
+            continue;
+        schedules[s].samples += samples;
+        if (is_due(s, timestamp))
+            mask |= 1u << s;
+    }
+    // 上一轮还没算完时推迟到下一个 epoch, 计数保留
+    if (!mask || busy.load(std::memory_order_acquire))
+        return applied;
+
+    take_snapshot(mask);
+    for (int s = 0; s < SLOTS; s++) {
+        if (mask & (1u << s))
+            schedules[s] = {0, timestamp};
+    }
+    {
+        std::lock_guard lock(mutex);
+        due_mask = mask;
+        busy.store(true, std::memory_order_relaxed);
+    }
+    cv.notify_one();
+    return applied;
+}
+
+size_t PolicyScheduler::flush() {
+    size_t applied = 0;
+    // worker 可能在等待队列空间, 等待期间持续应用计划
+    while (busy.load(std::memory_order_acquire)) {
+        applied += apply();
+        std::this_thread::yield();
+    }
+    return applied + apply();
+}
+
+void PolicyScheduler::take_snapshot(unsigned mask) {
+    auto &snap = *snapshot;
+    snap.last_timestamp = controller->last_timestamp;
+    snap.page_type_ = controller->page_type_;
+    snap.capacity = controller->capacity;
+    // 只重放上次快照以来的改动, 开销与改动数成正比
+    controller->occupation.sync_to(snap.occupation, local_reader);
+    // 负载均衡类策略读取访问计数
+    snap.counter = controller->counter;
+    for (size_t i = 0; i < snapshot_expanders.size(); i++) {
+        auto *expander = controller->cur_expanders[i];
+        // 同步会推进本订阅者的游标, 需要独占
+        std::unique_lock lock(expander->occupationMutex_);
+        expander->occupation.sync_to(snapshot_expanders[i]->occupation, expander_readers[i]);
+        snapshot_expanders[i]->counter = expander->counter;
+    }
+    // 只在缓存策略到期时同步, 期间改动过的组会累积, 但不超过组数
+    if (mask & (1u << CACHING))
+        controller->host_cache.sync_to(snap.host_cache);
+}
+
+void PolicyScheduler::run(std::stop_token stop) {
+    while (true) {
+        unsigned mask;
+        {
+            std::unique_lock lock(mutex);
+            if (!cv.wait(lock, stop, [&] { return due_mask != 0; }))
+                return;
+            mask = std::exchange(due_mask, 0);
+        }
+        auto *snap = snapshot.get();
+        if (mask & (1u << MIGRATION)) {
+            auto *policy = controller->migration_policy;
+            if (policy->compute_once(snap) > 0) {
+                for (const auto &[addr, size] : policy->get_migration_list(snap))
+                    emit({policy_plan::MIGRATE, addr, size}, stop);
+            }
+        }
+        if (mask & (1u << CACHING)) {
+            auto *policy = controller->caching_policy;
+            if (policy->compute_once(snap) > 0) {
+                for (auto addr : policy->get_invalidation_list(snap))
+                    emit({policy_plan::INVALIDATE, addr, 0}, stop);
+            }
+        }
+        busy.store(false, std::memory_order_release);
+    }
+}
+
+void PolicyScheduler::emit(const policy_plan &plan, const std::stop_token &stop) {
+    // 队列满时等待摄取线程在下一个 epoch 取走计划
+    while (!plans.try_push(plan)) {
+        if (stop.stop_requested())
+            return;
+        std::this_thread::yield();
+    }
+}
+
+size_t PolicyScheduler::apply() {
+    return plans.consume_all([&](const policy_plan &plan) {
+        if (plan.kind == policy_plan::MIGRATE)
+            controller->migrate(plan.addr, plan.size);
+        else
+            controller->back_invalidate(plan.addr);
+    });
+}
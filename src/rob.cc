@@ -224,7 +224,8 @@ int main(int argc, char *argv[]) {
     options.add_options()("t,target", "The script file to execute",
                           cxxopts::value<std::string>()->default_value("/trace.out"))(
         "h,help", "Help for CXLMemSimRoB", cxxopts::value<bool>()->default_value("false"))(
-        "o,topology", "The newick tree input for the CXL memory expander topology",
+        "o,topology",
+        "The newick tree input for the CXL memory expander topology, branch lengths as latency/bandwidth",
         cxxopts::value<std::string>()->default_value("(1,(2,3))"))(
         "d,dramlatency", "The current platform's dram latency", cxxopts::value<double>()->default_value("110"))(
         "e,capacity", "The capacity vector of the CXL memory expander with the first local",
@@ -34,8 +34,7 @@ bool Rob::canRetire(const InstructionGroup &ins) {
 
     // 检查内存访问是否完成
     if (cur_latency == 0) {
-        auto allAccess = controller_->get_access(ins.retireTimestamp);
-        cur_latency = controller_->calculate_latency(allAccess, 80.);
+        cur_latency = controller_->calculate_latency(ins.retireTimestamp, 80.);
     }
     // SPDLOG_INFO("{}",cur_latency);
     if (currentCycle_ - ins.cycleCount >= cur_latency) {
@@ -59,8 +58,7 @@ void Rob::retire() {
 
     // 计算这条指令的实际延迟
     if (oldestIns.address != 0) {
-        auto allAccess = controller_->get_access(currentCycle_);
-        uint64_t latency = controller_->calculate_latency(allAccess, 80.); // also delete the latency
+        uint64_t latency = controller_->calculate_latency(currentCycle_, 80.); // also delete the latency
         totalLatency_ += latency;
     }
 
@@ -220,14 +218,12 @@ bool ParallelRob::processRetirement(InstructionGroup &ins, RobPartition &partiti
 
     // 检查内存访问是否完成
     if (partition.cur_latency == 0) {
-        auto allAccess = controller_->get_access(ins.retireTimestamp);
-        partition.cur_latency = controller_->calculate_latency(allAccess, 80.);
+        partition.cur_latency = controller_->calculate_latency(ins.retireTimestamp, 80.);
     }
 
     if (currentCycle_.load() - ins.cycleCount >= partition.cur_latency) {
         // 计算实际延迟
-        auto allAccess = controller_->get_access(currentCycle_.load());
-        uint64_t latency = controller_->calculate_latency(allAccess, 80.);
+        uint64_t latency = controller_->calculate_latency(currentCycle_.load(), 80.);
         totalLatency_ += latency;
 
         partition.cur_latency = 0;
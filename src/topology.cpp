@@ -0,0 +1,74 @@
+/*
+ * CXLMemSim topology
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#include "topology.h"
+#include "cxlendpoint.h"
+#include <algorithm>
+#include <unordered_map>
+
+static double link_cap(double bandwidth) { return bandwidth > 0 ? bandwidth : Topology::unlimited; }
+
+void Topology::compile(CXLSwitch *root, const std::vector<CXLMemExpander *> &devices) {
+    switches_.clear();
+    devices_.clear();
+
+    // 第一遍: 后序编号, 子交换机先于父交换机
+    std::unordered_map<const CXLSwitch *, uint32_t> index;
+    std::function<void(CXLSwitch *)> number = [&](CXLSwitch *sw) {
+        for (auto *child : sw->switches)
+            number(child);
+        index[sw] = switches_.size();
+        switches_.push_back(sw);
+    };
+    number(root);
+
+    // 第二遍: 记下每个设备到根的交换机序列, 祖先栈自根向下
+    std::vector<std::vector<const CXLSwitch *>> chain(devices.size());
+    std::vector<const CXLSwitch *> ancestors;
+    std::function<void(const CXLSwitch *)> walk = [&](const CXLSwitch *sw) {
+        ancestors.push_back(sw);
+        for (auto *expander : sw->expanders) {
+            if (expander->id < 0 || (size_t)expander->id >= devices.size() || !chain[expander->id].empty())
+                continue;
+            devices_.push_back(expander->id);
+            chain[expander->id].assign(ancestors.rbegin(), ancestors.rend());
+        }
+        for (auto *child : sw->switches)
+            walk(child);
+        ancestors.pop_back();
+    };
+    walk(root);
+
+    first_.assign(devices.size() + 1, 0);
+    paths_.clear();
+    caps_.clear();
+    latency_.assign(devices.size(), 0.0);
+    for (size_t d = 0; d < devices.size(); d++) {
+        first_[d] = paths_.size();
+        if (chain[d].empty())
+            continue;
+        auto *expander = devices[d];
+        double latency = (expander->latency.read + expander->latency.write) / 2.0 + expander->link_latency;
+        double cap = link_cap(expander->link_bandwidth);
+        for (size_t level = 0; level < chain[d].size(); level++) {
+            const auto *sw = chain[d][level];
+            paths_.push_back(index[sw]);
+            caps_.push_back(cap);
+            // 根没有上游链路
+            if (level + 1 < chain[d].size()) {
+                latency += sw->link_latency;
+                cap = std::min(cap, link_cap(sw->link_bandwidth));
+            }
+        }
+        latency_[d] = latency;
+    }
+    first_[devices.size()] = paths_.size();
+}
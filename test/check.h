@@ -0,0 +1,27 @@
+/*
+ * CXLMemSim test helpers
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#ifndef CXLMEMSIM_TEST_CHECK_H
+#define CXLMEMSIM_TEST_CHECK_H
+
+#include <cstdio>
+#include <cstdlib>
+
+// 与 assert 不同, Release 构建 (NDEBUG) 下同样检查
+#define CHECK(cond)                                                                                                    \
+    do {                                                                                                               \
+        if (!(cond)) {                                                                                                 \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                              \
+            std::exit(1);                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+#endif // CXLMEMSIM_TEST_CHECK_H
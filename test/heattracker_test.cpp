@@ -0,0 +1,75 @@
+/*
+ * CXLMemSim heat tracker tests
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#include "check.h"
+#include "heattracker.h"
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <random>
+
+static bool near(double a, double b) { return std::fabs(a - b) <= 1e-6 * std::max(1.0, std::fabs(b)); }
+
+// 少量热页混在大量冷页中: 热页全部留在 top-K, 候选数不超过 K; 冷页只在空余的槽位间轮换
+static void test_top_k() {
+    const size_t k = 16, hot_pages = 8;
+    HeatTracker tracker(k, 4096, 4, 1000000000);
+    std::mt19937_64 rng(3);
+    for (int round = 0; round < 100; round++) {
+        for (uint64_t page = 0; page < hot_pages; page++)
+            tracker.record((page << 12) + rng() % 4096, round, 10);
+        for (int cold = 0; cold < 50; cold++)
+            tracker.record((1000 + rng() % 100000) << 12, round);
+    }
+    std::map<uint64_t, double> hot;
+    size_t listed = 0;
+    tracker.for_each_hot(0, [&](uint64_t, double) { listed++; });
+    CHECK(listed <= k);
+    tracker.for_each_hot(500, [&](uint64_t addr, double heat) { hot[addr >> 12] = heat; });
+    CHECK(hot.size() == hot_pages);
+    for (uint64_t page = 0; page < hot_pages; page++) {
+        CHECK(hot.count(page));
+        CHECK(hot[page] >= 1000 * 0.99); // 衰减可忽略, 计数只会高估
+        CHECK(tracker.estimate(page << 12) >= 1000 * 0.99);
+    }
+}
+
+// 经过 n 个半衰期后热度降为 2^-n, 新近的页排在旧页之前
+static void test_decay() {
+    const uint64_t half_life = 1000;
+    HeatTracker tracker(16, 4096, 4, half_life);
+    tracker.record(0x1000, 0, 1024);
+    for (int n = 1; n <= 5; n++) {
+        tracker.record(0x2000, n * half_life);
+        CHECK(near(tracker.estimate(0x1000), 1024.0 / (1 << n)));
+    }
+    tracker.record(0x3000, 5 * half_life, 64);
+    std::map<uint64_t, double> hot;
+    tracker.for_each_hot(40, [&](uint64_t addr, double heat) { hot[addr] = heat; });
+    CHECK(hot.size() == 1 && hot.count(0x3000) && near(hot[0x3000], 64));
+    tracker.for_each_hot(30, [&](uint64_t addr, double heat) { hot[addr] = heat; });
+    CHECK(hot.size() == 2 && near(hot[0x1000], 32));
+
+    // 跨越大量半衰期 (触发重新缩放) 后数值保持有限且正确
+    for (uint64_t n = 6; n <= 5000; n++)
+        tracker.record(0x4000, n * half_life);
+    CHECK(std::isfinite(tracker.estimate(0x4000)));
+    CHECK(near(tracker.estimate(0x4000), 2)); // 每个半衰期一次访问, 稳态热度为 1 + 1/2 + 1/4 + ... = 2
+    CHECK(tracker.estimate(0x1000) < 1e-9);
+    tracker.clear();
+    CHECK(tracker.estimate(0x4000) == 0);
+}
+
+int main() {
+    test_top_k();
+    test_decay();
+    std::printf("heattracker_test passed\n");
+}
@@ -0,0 +1,172 @@
+/*
+ * CXLMemSim occupation store tests
+ *
+ *  By: Andrew Quinn
+ *      Yiwei Yang
+ *      Brian Zhao
+ *  SPDX-License-Identifier: (LGPL-2.1 OR BSD-2-Clause)
+ *  Copyright 2025 Regents of the University of California
+ *  UC Santa Cruz Sluglab.
+ */
+
+#include "check.h"
+#include "occupation.h"
+#include <cstdio>
+#include <random>
+#include <set>
+#include <vector>
+
+// 两个存储的内容与环形顺序完全一致
+static bool same(const OccupationStore &a, const OccupationStore &b) {
+    auto i = a.begin(), j = b.begin();
+    for (; i != a.end() && j != b.end(); ++i, ++j) {
+        auto x = *i, y = *j;
+        if (x.address != y.address || x.timestamp != y.timestamp || x.access_count != y.access_count ||
+            x.reads != y.reads || x.writes != y.writes)
+            return false;
+    }
+    return i == a.end() && j == b.end() && a.size() == b.size() && a.evicted() == b.evicted();
+}
+
+// 带权重的 record 等价于逐次 record: 第一次可以是写, 其余都是读
+static void test_weighted_record(unsigned shift, size_t max_bytes) {
+    std::mt19937_64 rng(shift * 1000 + max_bytes);
+    OccupationStore weighted, single;
+    weighted.configure(shift, max_bytes);
+    single.configure(shift, max_bytes);
+    for (uint64_t t = 1; t <= 50000; t++) {
+        uint64_t addr = (rng() % 20000) * 64 + rng() % 64;
+        bool is_write = rng() & 1;
+        uint64_t weight = 1 + rng() % 5;
+        bool existed = weighted.record(addr, t, is_write, weight);
+        CHECK(single.record(addr, t, is_write) == existed);
+        for (uint64_t k = 1; k < weight; k++)
+            CHECK(single.record(addr, t, false));
+    }
+    CHECK(same(weighted, single));
+    if (max_bytes)
+        CHECK(weighted.evicted() > 0);
+}
+
+// 随机 record/touch/erase/erase_range 并触发淘汰后, 经 sync_to 同步的影子副本与源一致
+static void test_sync_to() {
+    std::mt19937_64 rng(7);
+    OccupationStore source, fresh, lagging;
+    source.configure(6, 5000 * sizeof(occupation_info));
+    size_t fresh_reader = source.subscribe(), lagging_reader = source.subscribe();
+    uint64_t t = 0;
+    for (int round = 0; round < 200; round++) {
+        for (int k = 0; k < 1000; k++, t++) {
+            uint64_t addr = (rng() % 20000) * 64;
+            switch (rng() % 6) {
+            case 0:
+                source.erase(addr);
+                break;
+            case 1:
+                source.erase_range(addr, addr + 64 * (rng() % 8));
+                break;
+            case 2:
+                source.touch(addr, t, 5);
+                break;
+            default:
+                source.record(addr, t, rng() & 1, 1 + rng() % 3);
+            }
+        }
+        if (round == 100)
+            source.configure(12, 0); // 粒度变化会清空源
+        source.sync_to(fresh, fresh_reader);
+        CHECK(same(source, fresh));
+        if (round % 37 == 0) { // 落后的订阅者
+            source.sync_to(lagging, lagging_reader);
+            CHECK(same(source, lagging));
+        }
+    }
+    CHECK(source.evicted() > 0);
+}
+
+// 相邻地址合并成一个区间, 删除中间地址时拆分
+static void test_range_coalescing() {
+    AddressRangeSet set;
+    set.insert(1);
+    set.insert(2);
+    set.insert(3);
+    CHECK(set.size() == 1);
+    set.insert(5);
+    CHECK(set.size() == 2);
+    CHECK(!set.contains(4) && set.contains(5));
+    CHECK(!set.overlaps(4, 4) && set.overlaps(4, 5) && set.overlaps(0, 1));
+    set.insert(4);
+    CHECK(set.size() == 1);
+    CHECK(set.begin()->first == 1 && set.begin()->second == 5);
+    set.erase(3);
+    CHECK(set.size() == 2 && !set.contains(3));
+    set.erase(1);
+    set.erase(5);
+    CHECK(set.size() == 2 && set.begin()->first == 2 && set.begin()->second == 2);
+    std::vector<uint64_t> seen;
+    set.for_each_in(0, 10, [&](uint64_t addr) { seen.push_back(addr); });
+    CHECK((seen == std::vector<uint64_t>{2, 4}));
+    set.erase(2);
+    set.erase(4);
+    CHECK(set.empty());
+
+    // 与 std::set 对照: 包含关系一致, 且区间之间不相邻 (已完全合并)
+    std::mt19937_64 rng(11);
+    std::set<uint64_t> model;
+    for (int k = 0; k < 100000; k++) {
+        uint64_t addr = rng() % 2000;
+        if (rng() % 3) {
+            set.insert(addr);
+            model.insert(addr);
+        } else {
+            set.erase(addr);
+            model.erase(addr);
+        }
+    }
+    size_t covered = 0;
+    uint64_t prev_end = 0;
+    bool first = true;
+    for (auto [start, end] : set) {
+        CHECK(start <= end);
+        CHECK(first || start > prev_end + 1);
+        covered += end - start + 1;
+        prev_end = end;
+        first = false;
+    }
+    CHECK(covered == model.size());
+    for (uint64_t addr = 0; addr < 2000; addr++)
+        CHECK(set.contains(addr) == (model.count(addr) > 0));
+    seen.clear();
+    set.for_each_in(500, 1500, [&](uint64_t addr) { seen.push_back(addr); });
+    CHECK((seen == std::vector<uint64_t>(model.lower_bound(500), model.upper_bound(1500))));
+}
+
+// 存储的地址区间与其中的记录一一对应
+static void test_store_ranges() {
+    std::mt19937_64 rng(13);
+    OccupationStore store;
+    store.configure(0, 500 * sizeof(occupation_info));
+    for (uint64_t t = 1; t <= 20000; t++) {
+        uint64_t addr = rng() % 1000;
+        if (rng() % 4)
+            store.record(addr, t, false);
+        else
+            store.erase_range(addr, addr + rng() % 4);
+    }
+    size_t covered = 0;
+    for (auto [start, end] : store.ranges())
+        covered += end - start + 1;
+    CHECK(covered == store.size());
+    for (auto info : store)
+        CHECK(store.ranges().contains(info.address));
+}
+
+int main() {
+    test_weighted_record(6, 0);
+    test_weighted_record(12, 0);
+    test_weighted_record(6, 4000 * sizeof(occupation_info)); // 上限触发 LRU 淘汰
+    test_sync_to();
+    test_range_coalescing();
+    test_store_ranges();
+    std::printf("occupation_test passed\n");
+}